@@ -30,12 +30,23 @@ returns text as $$
 --      txids that actually happened between two snapshots.  For txids
 --      in the range [xmin1..xmax1] look which ones were actually
 --      committed between snapshots and search for them using exact
---      values using IN (..) list.
+--      values using = ANY (array) list.
 --
 --      2) As most TX are short, there could be lot of them that were
 --      just below xmax1, but were committed before xmax2.  So look
 --      if there are ID's near xmax1 and lower the range to include
---      them, thus decresing size of IN (..) list.
+--      them, thus decresing size of the list.
+--
+--      Snapshots are given to pgq.txid_in_batch() as constants,
+--      so it can decode them once per query instead of once per row.
+--      Older txids are given as single array constant, so it stays
+--      one expression that newer servers evaluate with hash lookup.
+--
+--      If batch is split by pgq.next_batch_custom(6), ev_id range
+--      of current part is added to both scans.
+--
+--      C version of pgq.get_batch_events() does not use this function,
+--      it keeps prepared plans per queue and passes values as parameters.
 -- ----------------------------------------------------------------------
 declare
     rec             record;
@@ -45,9 +56,11 @@ declare
     part            text;
     select_fields   text;
     retry_expr      text;
+    snap_args       text;
     batch           record;
 begin
     select s.sub_last_tick, s.sub_next_tick, s.sub_id, s.sub_queue,
+           s.sub_batch_start_id, s.sub_batch_end_id,
            txid_snapshot_xmax(last.tick_snapshot) as tx_start,
            txid_snapshot_xmax(cur.tick_snapshot) as tx_end,
            last.tick_snapshot as last_snapshot,
@@ -91,6 +104,16 @@ begin
         || ' ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4';
     retry_expr :=  ' and (ev_owner is null or ev_owner = '
         || batch.sub_id::text || ')';
+    -- part of split batch
+    if batch.sub_batch_start_id is not null then
+        retry_expr := retry_expr || ' and ev_id >= ' || batch.sub_batch_start_id::text;
+    end if;
+    if batch.sub_batch_end_id is not null then
+        retry_expr := retry_expr || ' and ev_id < ' || batch.sub_batch_end_id::text;
+    end if;
+    -- constant snapshots, so pgq.txid_in_batch() can decode them once
+    snap_args := quote_literal(batch.last_snapshot::text) || '::txid_snapshot, '
+        || quote_literal(batch.cur_snapshot::text) || '::txid_snapshot';
 
     -- now generate query that goes over all potential tables
     sql := '';
@@ -100,22 +123,17 @@ begin
         tbl := pgq.quote_fqname(rec.xtbl);
         -- this gets newer queries that definitely are not in prev_snapshot
         part := select_fields
-            || ' from pgq.tick cur, pgq.tick last, ' || tbl || ' ev '
-            || ' where cur.tick_id = ' || batch.sub_next_tick::text
-            || ' and cur.tick_queue = ' || batch.sub_queue::text
-            || ' and last.tick_id = ' || batch.sub_last_tick::text
-            || ' and last.tick_queue = ' || batch.sub_queue::text
-            || ' and ev.ev_txid >= ' || batch.tx_start::text
+            || ' from ' || tbl || ' ev '
+            || ' where ev.ev_txid >= ' || batch.tx_start::text
             || ' and ev.ev_txid <= ' || batch.tx_end::text
-            || ' and txid_visible_in_snapshot(ev.ev_txid, cur.tick_snapshot)'
-            || ' and not txid_visible_in_snapshot(ev.ev_txid, last.tick_snapshot)'
+            || ' and pgq.txid_in_batch(ev.ev_txid, ' || snap_args || ')'
             || retry_expr;
         -- now include older tx-es, that were ongoing
         -- at the time of prev_snapshot
         if arr <> '' then
             part := part || ' union all '
                 || select_fields || ' from ' || tbl || ' ev '
-                || ' where ev.ev_txid in (' || arr || ')'
+                || ' where ev.ev_txid = any (''{' || arr || '}''::int8[])'
                 || retry_expr;
         end if;
         if sql = '' then
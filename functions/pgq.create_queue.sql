@@ -67,6 +67,9 @@ begin
                 || ' SET DEFAULT nextval(' || quote_literal(ev_seq) || ')';
         execute 'create index ' || quote_ident(idxname) || ' on '
                 || pgq.quote_fqname(tblname) || ' (ev_txid)';
+        -- lets ordered batch read avoid sort
+        execute 'create index ' || quote_ident(idxpfx || '_' || i::text || '_id_idx')
+                || ' on ' || pgq.quote_fqname(tblname) || ' (ev_id)';
     end loop;
 
     perform pgq.grant_perms(i_queue_name);
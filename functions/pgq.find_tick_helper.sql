@@ -13,6 +13,9 @@ as $$
 -- Function: pgq.find_tick_helper(6)
 --
 --      Helper function for pgq.next_batch_custom() to do extended tick search.
+--
+--      Event counts come from event id sequence, with queue_event_id_block > 1
+--      they include reserved but unused ids, so they are upper estimates.
 -- ----------------------------------------------------------------------
 declare
     sure    boolean;
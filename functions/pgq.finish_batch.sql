@@ -8,6 +8,9 @@ returns integer as $$
 --      Closes a batch.  No more operations can be done with events
 --      of this batch.
 --
+--      If batch was split by pgq.next_batch_custom(6), consumer stays
+--      on same ticks and next batch continues where this one ended.
+--
 -- Parameters:
 --      x_batch_id      - id of batch.
 --
@@ -20,9 +23,18 @@ returns integer as $$
 -- ----------------------------------------------------------------------
 begin
     update pgq.subscription
-        set sub_active = now(),
-            sub_last_tick = sub_next_tick,
-            sub_next_tick = null,
+        set sub_batch_time = case when sub_batch_started is null then sub_batch_time
+                                  when sub_batch_time is null then clock_timestamp() - sub_batch_started
+                                  else sub_batch_time * 0.75
+                                       + (clock_timestamp() - sub_batch_started) * 0.25 end,
+            sub_batch_started = null,
+            sub_active = now(),
+            sub_last_tick = case when sub_batch_end_id is null
+                                 then sub_next_tick else sub_last_tick end,
+            sub_next_tick = case when sub_batch_end_id is null
+                                 then null else sub_next_tick end,
+            sub_batch_start_id = sub_batch_end_id,
+            sub_batch_end_id = null,
             sub_batch = null
         where sub_batch = x_batch_id;
     if not found then
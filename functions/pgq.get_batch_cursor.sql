@@ -30,7 +30,8 @@ returns setof record as $$
 -- Returns:
 --      List of events.
 -- Calls:
---      pgq.batch_event_sql(i_batch_id) - internal function which generates SQL optimised specially for getting events in this batch
+--      pgq.get_batch_events(i_batch_id) - the cursor reads the ordered merge
+--      of event tables directly, so events are streamed without a sort step.
 -- ----------------------------------------------------------------------
 declare
     _cname  text;
@@ -41,14 +42,15 @@ begin
     end if;
 
     _cname := quote_ident(i_cursor_name);
-    _sql := pgq.batch_event_sql(i_batch_id);
+    -- events come out of get_batch_events() already in ev_id order,
+    -- function call in target list avoids materializing them first
+    _sql := 'select (_b.ev).* from (select pgq.get_batch_events('
+        || i_batch_id::text || ') as ev offset 0) _b';
 
-    -- apply extra where
+    -- apply extra where, filter keeps the order
     if i_extra_where is not null then
-        _sql := replace(_sql, ' order by 1', '');
         _sql := 'select * from (' || _sql
-            || ') _evs where ' || i_extra_where
-            || ' order by 1';
+            || ') _evs where ' || i_extra_where;
     end if;
 
     -- create cursor
@@ -101,15 +101,16 @@ returns setof record as $$
 declare
     _pending_events bigint;
     _queue_id bigint;
+    _id_block integer;
 begin
     for queue_name, consumer_name, lag, last_seen,
-        last_tick, current_batch, next_tick, _pending_events, _queue_id
+        last_tick, current_batch, next_tick, _pending_events, _queue_id, _id_block
     in
         select q.queue_name, c.co_name,
                current_timestamp - t.tick_time,
                current_timestamp - s.sub_active,
                s.sub_last_tick, s.sub_batch, s.sub_next_tick,
-               t.tick_event_seq, q.queue_id
+               t.tick_event_seq, q.queue_id, q.queue_event_id_block
           from pgq.queue q,
                pgq.consumer c,
                pgq.subscription s
@@ -121,7 +122,7 @@ begin
            and (i_consumer_name is null or c.co_name = i_consumer_name)
          order by 1,2
     loop
-        select t.tick_event_seq - _pending_events
+        select (t.tick_event_seq - _pending_events) / _id_block
             into pending_events
             from pgq.tick t
             where t.tick_queue = _queue_id
@@ -94,18 +94,19 @@ declare
     _ht_tick_event_seq bigint;
     _queue_id integer;
     _queue_event_seq text;
+    _id_block integer;
 begin
     for queue_name, queue_ntables, queue_cur_table, queue_rotation_period,
         queue_switch_time, queue_external_ticker, queue_ticker_paused,
         queue_ticker_max_count, queue_ticker_max_lag, queue_ticker_idle_period,
-        _queue_id, _queue_event_seq
+        _queue_id, _queue_event_seq, _id_block
     in select
         q.queue_name, q.queue_ntables, q.queue_cur_table,
         q.queue_rotation_period, q.queue_switch_time,
         q.queue_external_ticker, q.queue_ticker_paused,
         q.queue_ticker_max_count, q.queue_ticker_max_lag,
         q.queue_ticker_idle_period,
-        q.queue_id, q.queue_event_seq
+        q.queue_id, q.queue_event_seq, q.queue_event_id_block
         from pgq.queue q
         where (i_queue_name is null or q.queue_name = i_queue_name)
         order by q.queue_name
@@ -127,11 +128,12 @@ begin
             order by ht.tick_queue asc, ht.tick_id asc
             limit 1;
         if _ht_tick_time < _top_tick_time then
-            ev_per_sec = (_top_tick_event_seq - _ht_tick_event_seq) / extract(epoch from (_top_tick_time - _ht_tick_time));
+            ev_per_sec = (_top_tick_event_seq - _ht_tick_event_seq)::float8 / _id_block
+                         / extract(epoch from (_top_tick_time - _ht_tick_time));
         else
             ev_per_sec = null;
         end if;
-        ev_new = pgq.seq_getval(_queue_event_seq) - _top_tick_event_seq;
+        ev_new = (pgq.seq_getval(_queue_event_seq) - _top_tick_event_seq) / _id_block;
         last_tick_id = _top_tick_id;
         return next;
     end loop;
@@ -0,0 +1,61 @@
+create or replace function pgq.insert_event_batch(queue_name text, ev_type text[], ev_data text[])
+returns integer as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.insert_event_batch(3)
+--
+--      Insert several events into queue with one call.
+--
+-- Parameters:
+--      queue_name      - Name of the queue
+--      ev_type         - Array of user-specified types for the events
+--      ev_data         - Array of user data for the events
+--
+-- Returns:
+--      Number of events inserted.
+-- Calls:
+--      pgq.insert_event_batch(7)
+-- ----------------------------------------------------------------------
+begin
+    return pgq.insert_event_batch(queue_name, ev_type, ev_data, null, null, null, null);
+end;
+$$ language plpgsql;
+
+
+
+create or replace function pgq.insert_event_batch(
+    queue_name text, ev_type text[], ev_data text[],
+    ev_extra1 text[], ev_extra2 text[], ev_extra3 text[], ev_extra4 text[])
+returns integer as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.insert_event_batch(7)
+--
+--      Insert several events into queue with one call.  n-th elements
+--      of the arrays make up n-th event.  All non-NULL arrays must
+--      be same length, NULL array means NULL value for all events.
+--
+--      Compared to calling pgq.insert_event() in loop, the queue
+--      is looked up once and all events are written with
+--      single multi-row INSERT.
+--
+-- Parameters:
+--      queue_name      - Name of the queue
+--      ev_type         - Array of user-specified types for the events
+--      ev_data         - Array of user data for the events
+--      ev_extra1       - Array of extra data fields for the events
+--      ev_extra2       - Array of extra data fields for the events
+--      ev_extra3       - Array of extra data fields for the events
+--      ev_extra4       - Array of extra data fields for the events
+--
+-- Returns:
+--      Number of events inserted.
+-- Calls:
+--      pgq.insert_event_batch_raw(7)
+-- Tables directly manipulated:
+--      insert - pgq.insert_event_batch_raw(7), a C function, inserts into current event_N_M table
+-- ----------------------------------------------------------------------
+begin
+    return pgq.insert_event_batch_raw(queue_name,
+            ev_type, ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4);
+end;
+$$ language plpgsql security definer;
+
@@ -0,0 +1,111 @@
+create or replace function pgq.insert_wal_events(
+    i_queue_name text, i_slot_name text,
+    i_tables text default null, i_format text default 'json',
+    i_max_changes int4 default 10000)
+returns integer as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.insert_wal_events(5)
+--
+--      Move row changes from logical replication slot into queue.
+--      Events have same format as from pgq.jsontriga(), pgq.logutriga()
+--      or pgq.bintriga(), but are generated from WAL, so writes
+--      to the table do not pay for queue inserts.
+--
+--      Slot must use 'pgq_triggers' output plugin, and options must
+--      be same on each call:
+--
+-- >   select pg_create_logical_replication_slot('myslot', 'pgq_triggers');
+-- >   select pgq.insert_wal_events('myqueue', 'myslot', 'public.customer,public.orders');
+--
+--      Changes are peeked, and position of last inserted transaction
+--      is stored in pgq.wal_position in same transaction as events.
+--      Already inserted transactions are skipped, and slot is advanced
+--      only up to committed position on later call, so call that fails
+--      or is rolled back will see same changes again.
+--
+-- Parameters:
+--      i_queue_name    - Name of the queue
+--      i_slot_name     - Logical replication slot
+--      i_tables        - Comma-separated list of schema.table names, NULL for all tables
+--      i_format        - 'json' (jsontriga), 'urlenc' (logutriga) or 'msgpack' (bintriga)
+--      i_max_changes   - Stop after transaction that reaches this many changes
+--
+-- Returns:
+--      Number of events inserted.
+--
+-- Notes:
+--      Needs wal_level=logical and PostgreSQL 11+.  Without REPLICA IDENTITY FULL,
+--      DELETE events contain only pkey columns and UPDATE events leave out
+--      unchanged TOASTed columns.  Tables in pgq schema are never logged.
+--
+-- Calls:
+--      pgq.insert_event_batch(7)
+--
+-- Tables directly manipulated:
+--      insert/update - pgq.wal_position
+-- ----------------------------------------------------------------------
+declare
+    opts text[];
+    last_lsn pg_lsn;
+    ev_type text[];
+    ev_data text[];
+    ev_extra1 text[];
+    cnt integer := 0;
+    applied_lsn pg_lsn;
+    applied_txid bigint;
+    flush_lsn pg_lsn;
+begin
+    -- lock position row, this also serializes calls on same slot
+    insert into pgq.wal_position (wal_slot_name, wal_applied_lsn, wal_applied_txid)
+        values (i_slot_name, '0/0', 0)
+        on conflict (wal_slot_name) do nothing;
+    select wal_applied_lsn, wal_applied_txid
+        from pgq.wal_position
+        where wal_slot_name = i_slot_name
+        for update
+        into applied_lsn, applied_txid;
+
+    -- position is committed, slot can be moved there
+    if applied_txid <> txid_current() then
+        select s.confirmed_flush_lsn from pg_catalog.pg_replication_slots s
+            where s.slot_name = i_slot_name
+            into flush_lsn;
+        if flush_lsn < applied_lsn then
+            perform pg_catalog.pg_replication_slot_advance(i_slot_name, applied_lsn);
+        end if;
+    end if;
+
+    opts := array['format', i_format];
+    if i_tables is not null then
+        opts := opts || array['tables', i_tables];
+    end if;
+
+    -- each line is: ev_type <TAB> ev_extra1 <TAB> ev_data, or empty at commit.
+    -- commit line has largest lsn in transaction, skip transactions already applied.
+    select max(c.lsn),
+           array_agg(split_part(c.data, E'\t', 1) order by c.nr) filter (where c.data <> ''),
+           array_agg(substr(c.data, length(split_part(c.data, E'\t', 1))
+                                    + length(split_part(c.data, E'\t', 2)) + 3) order by c.nr)
+                filter (where c.data <> ''),
+           array_agg(split_part(c.data, E'\t', 2) order by c.nr) filter (where c.data <> '')
+        from (select p.lsn, p.data, p.nr, max(p.lsn) over (partition by p.xid::text) as commit_lsn
+                from pg_catalog.pg_logical_slot_peek_changes(i_slot_name, null, i_max_changes, variadic opts)
+                     with ordinality as p (lsn, xid, data, nr)) c
+        where c.commit_lsn > applied_lsn
+        into last_lsn, ev_type, ev_data, ev_extra1;
+
+    if ev_type is not null then
+        cnt := pgq.insert_event_batch(i_queue_name, ev_type, ev_data, ev_extra1, null, null, null);
+    end if;
+
+    if last_lsn is not null then
+        update pgq.wal_position
+            set wal_applied_lsn = last_lsn,
+                wal_applied_txid = txid_current()
+            where wal_slot_name = i_slot_name;
+    end if;
+
+    return cnt;
+end;
+$$ language plpgsql;
+
@@ -123,7 +123,69 @@ as $$
 --      prev_tick_time      - Start tick time.
 --      prev_tick_event_seq - value from event id sequence at the time tick was issued.
 -- Calls:
---      pgq.insert_event_raw(11)
+--      pgq.next_batch_custom(6)
+-- Tables directly manipulated:
+--      None
+-- ----------------------------------------------------------------------
+begin
+    select f.batch_id, f.cur_tick_id, f.prev_tick_id,
+           f.cur_tick_time, f.prev_tick_time,
+           f.cur_tick_event_seq, f.prev_tick_event_seq
+        into batch_id, cur_tick_id, prev_tick_id, cur_tick_time, prev_tick_time,
+             cur_tick_event_seq, prev_tick_event_seq
+        from pgq.next_batch_custom(i_queue_name, i_consumer_name,
+                                   i_min_lag, i_min_count, i_min_interval, NULL) f;
+    return;
+end;
+$$ language plpgsql;
+
+create or replace function pgq.next_batch_custom(
+    in i_queue_name text,
+    in i_consumer_name text,
+    in i_min_lag interval,
+    in i_min_count int4,
+    in i_min_interval interval,
+    in i_max_events int4,
+    out batch_id int8,
+    out cur_tick_id int8,
+    out prev_tick_id int8,
+    out cur_tick_time timestamptz,
+    out prev_tick_time timestamptz,
+    out cur_tick_event_seq int8,
+    out prev_tick_event_seq int8)
+as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.next_batch_custom(6)
+--
+--      Makes next block of events active.  Same as pgq.next_batch_custom(5),
+--      but can also limit the number of events in batch.
+--
+--      Larger batch is split by ev_id into parts of i_max_events.
+--      Each part is a separate batch with same ticks, pgq.finish_batch()
+--      remembers position and next call continues from there.  Consumer
+--      moves to next tick only after last part is finished.
+--
+--      Remaining parts are returned even if later calls do not
+--      give i_max_events, only their own limit is then dropped.
+--
+-- Parameters:
+--      i_queue_name        - Name of the queue
+--      i_consumer_name     - Name of the consumer
+--      i_min_lag           - Consumer wants events older than that
+--      i_min_count         - Consumer wants batch to contain at least this many events
+--      i_min_interval      - Consumer wants batch to cover at least this much time
+--      i_max_events        - Consumer wants batch to contain at most this many events
+--
+-- Returns:
+--      batch_id            - Batch ID or NULL if there are no more events available.
+--      cur_tick_id         - End tick id.
+--      cur_tick_time       - End tick time.
+--      cur_tick_event_seq  - Value from event id sequence at the time tick was issued.
+--      prev_tick_id        - Start tick id.
+--      prev_tick_time      - Start tick time.
+--      prev_tick_event_seq - value from event id sequence at the time tick was issued.
+-- Calls:
+--      pgq.get_batch_events(1)
 -- Tables directly manipulated:
 --      update - pgq.subscription
 -- ----------------------------------------------------------------------
@@ -132,11 +194,17 @@ declare
     queue_id        integer;
     sub_id          integer;
     cons_id         integer;
+    end_id          int8;
+    id_block        integer;
 begin
-    select s.sub_queue, s.sub_consumer, s.sub_id, s.sub_batch,
+    if i_max_events <= 0 then
+        raise exception 'i_max_events must be positive';
+    end if;
+
+    select s.sub_queue, s.sub_consumer, s.sub_id, s.sub_batch, q.queue_event_id_block,
             t1.tick_id, t1.tick_time, t1.tick_event_seq,
             t2.tick_id, t2.tick_time, t2.tick_event_seq
-        into queue_id, cons_id, sub_id, batch_id,
+        into queue_id, cons_id, sub_id, batch_id, id_block,
              prev_tick_id, prev_tick_time, prev_tick_event_seq,
              cur_tick_id, cur_tick_time, cur_tick_event_seq
         from pgq.consumer c,
@@ -170,30 +238,33 @@ begin
         return;
     end if;
 
-    if i_min_interval is null and i_min_count is null then
-        -- find next tick
-        select tick_id, tick_time, tick_event_seq
-            into cur_tick_id, cur_tick_time, cur_tick_event_seq
-            from pgq.tick
-            where tick_id > prev_tick_id
-              and tick_queue = queue_id
-            order by tick_queue asc, tick_id asc
-            limit 1;
-    else
-        -- find custom tick
-        select next_tick_id, next_tick_time, next_tick_seq
-          into cur_tick_id, cur_tick_time, cur_tick_event_seq
-          from pgq.find_tick_helper(queue_id, prev_tick_id,
-                                    prev_tick_time, prev_tick_event_seq,
-                                    i_min_count, i_min_interval);
-    end if;
+    -- without next tick, there is no unfinished split batch
+    if cur_tick_id is null then
+        if i_min_interval is null and i_min_count is null then
+            -- find next tick
+            select tick_id, tick_time, tick_event_seq
+                into cur_tick_id, cur_tick_time, cur_tick_event_seq
+                from pgq.tick
+                where tick_id > prev_tick_id
+                  and tick_queue = queue_id
+                order by tick_queue asc, tick_id asc
+                limit 1;
+        else
+            -- find custom tick, sequence moves by id_block per event
+            select next_tick_id, next_tick_time, next_tick_seq
+              into cur_tick_id, cur_tick_time, cur_tick_event_seq
+              from pgq.find_tick_helper(queue_id, prev_tick_id,
+                                        prev_tick_time, prev_tick_event_seq,
+                                        i_min_count * id_block, i_min_interval);
+        end if;
 
-    if i_min_lag is not null then
-        -- enforce min lag
-        if now() - cur_tick_time < i_min_lag then
-            cur_tick_id := NULL;
-            cur_tick_time := NULL;
-            cur_tick_event_seq := NULL;
+        if i_min_lag is not null then
+            -- enforce min lag
+            if now() - cur_tick_time < i_min_lag then
+                cur_tick_id := NULL;
+                cur_tick_time := NULL;
+                cur_tick_event_seq := NULL;
+            end if;
         end if;
     end if;
 
@@ -210,10 +281,25 @@ begin
     update pgq.subscription
         set sub_batch = batch_id,
             sub_next_tick = cur_tick_id,
+            sub_batch_end_id = null,
+            sub_batch_started = clock_timestamp(),
             sub_active = now()
         where sub_queue = queue_id
           and sub_consumer = cons_id;
+
+    -- cut batch before first event that does not fit,
+    -- reading stops there as events come in ev_id order
+    if i_max_events is not null then
+        select (x.ev).ev_id into end_id
+            from (select pgq.get_batch_events(batch_id) as ev
+                  offset i_max_events limit 1) x;
+        if end_id is not null then
+            update pgq.subscription
+                set sub_batch_end_id = end_id
+                where sub_queue = queue_id
+                  and sub_consumer = cons_id;
+        end if;
+    end if;
     return;
 end;
 $$ language plpgsql security definer;
-
@@ -97,6 +97,8 @@ begin
                 set sub_last_tick = x_tick_pos,
                     sub_batch = null,
                     sub_next_tick = null,
+                    sub_batch_start_id = null,
+                    sub_batch_end_id = null,
                     sub_active = now()
                 where sub_consumer = x_consumer_id
                   and sub_queue = x_queue_id;
@@ -14,6 +14,13 @@ returns integer as $$
 --      x_queue_name    - Name of the queue to configure.
 --      x_param_name    - Configuration parameter name.
 --      x_param_value   - Configuration parameter value.
+--
+--      Setting event_id_block also changes INCREMENT of queue's
+--      event id sequence, so each nextval() reserves block of
+--      that many ids.  C inserts hand out ids from the block,
+--      PL inserts use only last id of it.  Event counts are
+--      sequence movement divided by block size, so they count
+--      sequence calls: single events exactly, C batches by block.
 --  
 -- Returns:
 --     0 if event was already in queue, 1 otherwise.
@@ -24,6 +31,7 @@ returns integer as $$
 -- ----------------------------------------------------------------------
 declare
     v_param_name    text;
+    v_event_seq     text;
 begin
     -- discard NULL input
     if x_queue_name is null or x_param_name is null then
@@ -31,7 +39,8 @@ begin
     end if;
 
     -- check if queue exists
-    perform 1 from pgq.queue where queue_name = x_queue_name;
+    select queue_event_seq into v_event_seq
+        from pgq.queue where queue_name = x_queue_name;
     if not found then
         raise exception 'No such event queue';
     end if;
@@ -42,9 +51,12 @@ begin
         'queue_ticker_max_count',
         'queue_ticker_max_lag',
         'queue_ticker_idle_period',
+        'queue_ticker_target_count',
         'queue_ticker_paused',
         'queue_rotation_period',
-        'queue_external_ticker')
+        'queue_external_ticker',
+        'queue_buffer_events',
+        'queue_event_id_block')
     then
         raise exception 'cannot change parameter "%s"', x_param_name;
     end if;
@@ -53,6 +65,14 @@ begin
         || v_param_name || ' = ' || quote_literal(x_param_value)
         || ' where queue_name = ' || quote_literal(x_queue_name);
 
+    if v_param_name = 'queue_event_id_block' then
+        if x_param_value::int4 < 1 then
+            raise exception 'event_id_block must be positive';
+        end if;
+        execute 'alter sequence ' || pgq.quote_fqname(v_event_seq)
+            || ' increment by ' || x_param_value::int4 || ' cache 1';
+    end if;
+
     return 1;
 end;
 $$ language plpgsql security definer;
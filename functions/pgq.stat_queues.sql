@@ -0,0 +1,16 @@
+
+-- ----------------------------------------------------------------------
+-- View: pgq.stat_queues
+--
+--      Insert statistics for queues, collected in shared memory
+--      when pgq_lowlevel is in shared_preload_libraries.
+--      See <pgq.stat_queues_raw> for columns.
+--
+--      Counters are reset with pgq.stat_queues_reset().
+-- ----------------------------------------------------------------------
+create or replace view pgq.stat_queues as
+    select q.queue_name, s.events, s.bytes, s.max_event_size,
+           s.tx_limit_rejects, s.disabled_rejects, s.insert_latency_hist
+      from pgq.stat_queues_raw() s
+      join pgq.queue q on (q.queue_id = s.queue_id);
+
@@ -43,6 +43,13 @@ returns bigint as $$
 --
 --     For pgqadm usage.
 --
+--     With queue_ticker_target_count set, tick also when batch
+--     reaches that size, but not more often than slowest
+--     consumer finishes batches.  Batch time is kept on
+--     subscriptions as moving average.  Average event rate is
+--     kept on ticks, background ticker uses it only to predict
+--     when target is reached.
+--
 -- Parameters:
 --     i_queue_name     - Name of the queue
 --
@@ -54,12 +61,20 @@ declare
     q record;
     state record;
     last2 record;
+    has_events boolean;
+    tables text[];
+    tbl text;
+    batch_time interval;
+    adaptive_due boolean := false;
+    new_rate float8;
 begin
     select queue_id, queue_tick_seq, queue_external_ticker,
             queue_ticker_max_count, queue_ticker_max_lag,
-            queue_ticker_idle_period, queue_event_seq,
+            queue_ticker_idle_period, queue_ticker_target_count, queue_event_seq,
             pgq.seq_getval(queue_event_seq) as event_seq,
-            queue_ticker_paused
+            queue_ticker_paused, queue_event_id_block, queue_switch_step2,
+            queue_data_pfx || '_' || queue_cur_table::text as cur_table,
+            queue_data_pfx || '_' || ((queue_cur_table + queue_ntables - 1) % queue_ntables)::text as prev_table
         into q
         from pgq.queue where queue_name = i_queue_name;
     if not found then
@@ -76,8 +91,8 @@ begin
 
     -- load state from last tick
     select now() - tick_time as lag,
-           q.event_seq - tick_event_seq as new_events,
-           tick_id, tick_time, tick_event_seq,
+           (q.event_seq - tick_event_seq) / q.queue_event_id_block as new_events,
+           tick_id, tick_time, tick_event_seq, tick_snapshot, tick_event_rate,
            txid_snapshot_xmax(tick_snapshot) as sxmax,
            txid_snapshot_xmin(tick_snapshot) as sxmin
         into state
@@ -98,10 +113,47 @@ begin
             raise warning 'Dubious PgQ state: old xmax=%, cur txid=%', state.sxmax, txid_current();
         end if;
 
+        -- update moving average of event rate
+        new_rate := greatest(state.new_events, 0)
+                    / nullif(extract(epoch from state.lag)::float8, 0);
+        new_rate := coalesce(state.tick_event_rate * 0.75 + new_rate * 0.25,
+                             new_rate, state.tick_event_rate);
+
+        -- with event id blocks, inserts use ids reserved earlier
+        -- and sequence does not move, so look into tables that
+        -- next batch reads, as pgq.batch_event_tables() picks them
+        if state.new_events <= 0 and q.queue_event_id_block > 1 then
+            tables := array[q.cur_table];
+            if q.queue_switch_step2 is null or state.sxmin <= q.queue_switch_step2 then
+                tables := tables || q.prev_table;
+            end if;
+            foreach tbl in array tables loop
+                execute 'select true from ' || pgq.quote_fqname(tbl)
+                    || ' where ev_txid >= $1'
+                    || '   and not txid_visible_in_snapshot(ev_txid, $2)'
+                    || ' limit 1'
+                    into has_events
+                    using state.sxmin, state.tick_snapshot;
+                if has_events then
+                    state.new_events := 1;
+                    exit;
+                end if;
+            end loop;
+        end if;
+
         if state.new_events > 0 then
+            if q.queue_ticker_target_count > 0 then
+                select coalesce(max(sub_batch_time), '0') into batch_time
+                    from pgq.subscription
+                    where sub_queue = q.queue_id;
+                adaptive_due := state.lag >= batch_time
+                    and state.new_events >= q.queue_ticker_target_count;
+            end if;
+
             -- there are new events, should we wait a bit?
             if state.new_events < q.queue_ticker_max_count
                 and state.lag < q.queue_ticker_max_lag
+                and not coalesce(adaptive_due, false)
             then
                 return NULL;
             end if;
@@ -128,38 +180,10 @@ begin
         end if;
     end if;
 
-    insert into pgq.tick (tick_queue, tick_id, tick_event_seq)
-        values (q.queue_id, nextval(q.queue_tick_seq), q.event_seq);
+    insert into pgq.tick (tick_queue, tick_id, tick_event_seq, tick_event_rate)
+        values (q.queue_id, nextval(q.queue_tick_seq), q.event_seq, new_rate);
 
     return currval(q.queue_tick_seq);
 end;
 $$ language plpgsql security definer; -- unsure about access
 
-create or replace function pgq.ticker() returns bigint as $$
--- ----------------------------------------------------------------------
--- Function: pgq.ticker(0)
---
---     Creates ticks for all unpaused queues which dont have external ticker.
---
--- Returns:
---     Number of queues that were processed.
--- ----------------------------------------------------------------------
-declare
-    res bigint;
-    q record;
-begin
-    res := 0;
-    for q in
-        select queue_name from pgq.queue
-            where not queue_external_ticker
-                  and not queue_ticker_paused
-            order by queue_name
-    loop
-        if pgq.ticker(q.queue_name) > 0 then
-            res := res + 1;
-        end if;
-    end loop;
-    return res;
-end;
-$$ language plpgsql security definer;
-
@@ -2,6 +2,13 @@
 create or replace function pgq.upgrade_schema()
 returns int4 as $$
 -- updates table structure if necessary
+--
+-- ev_id index on event tables of existing queues is not created here,
+-- as plain CREATE INDEX would block inserts.  Ordered batch read works
+-- without it, but sorts each table.  It can be added online with:
+--
+--   create index concurrently event_<queue_id>_<n>_id_idx
+--       on pgq.event_<queue_id>_<n> (ev_id);
 declare
     cnt int4 = 0;
 begin
@@ -43,6 +50,59 @@ begin
         alter table pgq.queue add column queue_extra_maint text[];
     end if;
 
+    perform 1 from pg_attribute
+        where attrelid = 'pgq.queue'::regclass
+          and attname = 'queue_buffer_events';
+    if not found then
+        alter table pgq.queue add column queue_buffer_events boolean not null default false;
+    end if;
+
+    perform 1 from pg_attribute
+        where attrelid = 'pgq.queue'::regclass
+          and attname = 'queue_event_id_block';
+    if not found then
+        alter table pgq.queue add column queue_event_id_block integer not null default 1;
+    end if;
+
+    perform 1 from pg_attribute
+        where attrelid = 'pgq.subscription'::regclass
+          and attname = 'sub_batch_start_id';
+    if not found then
+        alter table pgq.subscription add column sub_batch_start_id bigint;
+        alter table pgq.subscription add column sub_batch_end_id bigint;
+    end if;
+
+    -- stats for adaptive ticking
+    perform 1 from pg_attribute
+        where attrelid = 'pgq.queue'::regclass
+          and attname = 'queue_ticker_target_count';
+    if not found then
+        alter table pgq.queue add column queue_ticker_target_count integer not null default 0;
+        alter table pgq.tick add column tick_event_rate float8;
+        alter table pgq.subscription add column sub_batch_time interval;
+    end if;
+
+    perform 1 from pg_attribute
+        where attrelid = 'pgq.subscription'::regclass
+          and attname = 'sub_batch_started';
+    if not found then
+        alter table pgq.subscription add column sub_batch_started timestamptz;
+    end if;
+
+    -- position for pgq.insert_wal_events()
+    perform 1 from pg_catalog.pg_tables
+        where schemaname = 'pgq' and tablename = 'wal_position';
+    if not found then
+        create table pgq.wal_position (
+            wal_slot_name       text            not null,
+            wal_applied_lsn     pg_lsn          not null,
+            wal_applied_txid    bigint          not null,
+
+            constraint wal_position_pkey primary key (wal_slot_name)
+        );
+        cnt := cnt + 1;
+    end if;
+
     return 0;
 end;
 $$ language plpgsql;
@@ -0,0 +1,501 @@
+/*
+ * batch_event.c - C implementation of pgq.get_batch_events().
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "txid_filter.h"
+
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
+
+#ifndef INT8ARRAYOID
+#define INT8ARRAYOID 1016
+#endif
+
+#ifndef PG_INT64_MAX
+#define PG_INT64_MAX	INT64CONST(0x7FFFFFFFFFFFFFFF)
+#define PG_INT64_MIN	(-PG_INT64_MAX - 1)
+#endif
+
+Datum pgq_get_batch_events(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_get_batch_events);
+
+/* rows fetched from cursor at once */
+#define BATCH_FETCH_ROWS	1000
+
+/* old txids this close to range start are included in range */
+#define TXID_RANGE_SLACK	100
+
+/* must match pgq.event_template and function result */
+#define EVENT_FIELDS \
+	"ev_id, ev_time, ev_txid, ev_retry, ev_type," \
+	" ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4"
+#define EVENT_NCOLS	10
+#define COL_TXID	2
+
+#define BATCH_INFO_SQL \
+	"select s.sub_id, s.sub_queue," \
+	"       last.tick_snapshot::text, cur.tick_snapshot::text," \
+	"       txid_snapshot_xmin(last.tick_snapshot)," \
+	"       txid_snapshot_xmax(cur.tick_snapshot)," \
+	"       q.queue_data_pfx, q.queue_ntables, q.queue_cur_table," \
+	"       q.queue_switch_step1, q.queue_switch_step2," \
+	"       s.sub_batch_start_id, s.sub_batch_end_id" \
+	"  from pgq.subscription s, pgq.tick last, pgq.tick cur, pgq.queue q" \
+	" where s.sub_batch = $1" \
+	"   and last.tick_queue = s.sub_queue" \
+	"   and last.tick_id = s.sub_last_tick" \
+	"   and cur.tick_queue = s.sub_queue" \
+	"   and cur.tick_id = s.sub_next_tick" \
+	"   and q.queue_id = s.sub_queue"
+
+enum BatchInfoCols {
+	COL_SUB_ID = 1,
+	COL_QUEUE_ID,
+	COL_LAST_SNAP,
+	COL_CUR_SNAP,
+	COL_LAST_XMIN,
+	COL_CUR_XMAX,
+	COL_PREFIX,
+	COL_NTABLES,
+	COL_CUR_TABLE,
+	COL_SWITCH1,
+	COL_SWITCH2,
+	COL_START_ID,
+	COL_END_ID,
+};
+
+/* which event tables are scanned */
+#define SCAN_PREV	1
+#define SCAN_NEXT	2
+#define SCAN_BOTH	(SCAN_PREV | SCAN_NEXT)
+
+/*
+ * Plan cache entry in HTAB, per queue.
+ */
+struct BatchPlanEntry {
+	Oid queue_id;
+	int cur_table;
+	void *plans[SCAN_BOTH];		/* unordered, indexed by scan mask - 1 */
+	void *ordered_plans[2];		/* per table, ordered by ev_id */
+};
+
+static HTAB *plan_cache;
+
+/*
+ * Cursor over event tables, read in chunks.
+ */
+struct EventStream {
+	char *portal_name;
+
+	/* current chunk of visible rows */
+	MemoryContext chunk_ctx;
+	HeapTuple *rows;
+	int nrows;
+	int pos;
+	bool eof;
+};
+
+/* ordered mode has cursor per table */
+#define MAX_STREAMS	2
+
+struct BatchState {
+	struct PgqTxidFilter *filter;
+	TupleDesc desc;
+
+	int nstreams;
+	struct EventStream streams[MAX_STREAMS];
+};
+
+static void append_event_table(StringInfo sql, const char *prefix, int nr)
+{
+	char name[NAMEDATALEN * 2 + 16];
+	char *dot;
+
+	snprintf(name, sizeof(name), "%s_%d", prefix, nr);
+	dot = strchr(name, '.');
+	if (dot) {
+		*dot = 0;
+		appendStringInfo(sql, "%s.%s", quote_identifier(name), quote_identifier(dot + 1));
+	} else {
+		appendStringInfoString(sql, quote_identifier(name));
+	}
+}
+
+/*
+ * Scan for one table.  Range part gets txids that started
+ * between ticks, list part older ones that were running
+ * at previous tick.  Visibility is checked when reading.
+ */
+static void append_table_scan(StringInfo sql, const char *prefix, int nr)
+{
+	if (sql->len > 0)
+		appendStringInfoString(sql, " union all ");
+	appendStringInfoString(sql, "select " EVENT_FIELDS " from ");
+	append_event_table(sql, prefix, nr);
+	appendStringInfoString(sql, " where ev_txid >= $1 and ev_txid < $2"
+			       " and (ev_owner is null or ev_owner = $3)"
+			       " and ev_id >= $5 and ev_id < $6");
+	appendStringInfoString(sql, " union all select " EVENT_FIELDS " from ");
+	append_event_table(sql, prefix, nr);
+	appendStringInfoString(sql, " where ev_txid = any ($4)"
+			       " and (ev_owner is null or ev_owner = $3)"
+			       " and ev_id >= $5 and ev_id < $6");
+}
+
+/*
+ * Scan for one table in ev_id order, can use ev_id index
+ * instead of sorting.  Tables are merged when reading.
+ */
+static void append_ordered_scan(StringInfo sql, const char *prefix, int nr)
+{
+	appendStringInfoString(sql, "select " EVENT_FIELDS " from ");
+	append_event_table(sql, prefix, nr);
+	appendStringInfoString(sql, " where ((ev_txid >= $1 and ev_txid < $2) or ev_txid = any ($4))"
+			       " and (ev_owner is null or ev_owner = $3)"
+			       " and ev_id >= $5 and ev_id < $6"
+			       " order by ev_id");
+}
+
+/*
+ * Fetch plan for scanning given tables of the queue.
+ * In ordered mode, scan must be single table.
+ *
+ * Batch-specific values are parameters, so plans are
+ * reused until queue rotates to next table.
+ */
+static void *load_batch_plan(Oid queue_id, const char *prefix, int ntables, int cur_table,
+			     int scan, bool ordered)
+{
+	Oid types[6] = { INT8OID, INT8OID, INT4OID, INT8ARRAYOID, INT8OID, INT8OID };
+	int prev_table = cur_table > 0 ? cur_table - 1 : ntables - 1;
+	struct BatchPlanEntry *entry;
+	StringInfoData sql;
+	HASHCTL ctl;
+	bool found;
+	void **slot;
+	void *plan;
+	int i;
+
+	if (!plan_cache) {
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(struct BatchPlanEntry);
+		plan_cache = hash_create("pgq_get_batch_events plans cache", 128, &ctl,
+					 HASH_ELEM | HASH_BLOBS);
+	}
+
+	entry = hash_search(plan_cache, &queue_id, HASH_ENTER, &found);
+	if (!found || entry->cur_table != cur_table) {
+		for (i = 0; i < SCAN_BOTH; i++) {
+			if (found && entry->plans[i])
+				SPI_freeplan(entry->plans[i]);
+			entry->plans[i] = NULL;
+		}
+		for (i = 0; i < 2; i++) {
+			if (found && entry->ordered_plans[i])
+				SPI_freeplan(entry->ordered_plans[i]);
+			entry->ordered_plans[i] = NULL;
+		}
+		entry->cur_table = cur_table;
+	}
+	slot = ordered ? &entry->ordered_plans[scan - 1] : &entry->plans[scan - 1];
+	if (*slot)
+		return *slot;
+
+	initStringInfo(&sql);
+	if (ordered) {
+		append_ordered_scan(&sql, prefix, scan == SCAN_PREV ? prev_table : cur_table);
+	} else {
+		if (scan & SCAN_PREV)
+			append_table_scan(&sql, prefix, prev_table);
+		if (scan & SCAN_NEXT)
+			append_table_scan(&sql, prefix, cur_table);
+	}
+
+	plan = SPI_prepare(sql.data, 6, types);
+	if (plan == NULL)
+		elog(ERROR, "pgq.get_batch_events: SPI_prepare() failed");
+	*slot = SPI_saveplan(plan);
+	SPI_freeplan(plan);
+	pfree(sql.data);
+	return *slot;
+}
+
+static void open_stream(struct BatchState *st, void *plan, Datum *values, MemoryContext ctx)
+{
+	struct EventStream *s = &st->streams[st->nstreams++];
+	Portal portal;
+
+	portal = SPI_cursor_open(NULL, plan, values, NULL, true);
+	if (portal == NULL)
+		elog(ERROR, "pgq.get_batch_events: cannot open cursor");
+	s->portal_name = MemoryContextStrdup(ctx, portal->name);
+	s->chunk_ctx = AllocSetContextCreate(ctx,
+					     "pgq batch events",
+#if (PG_VERSION_NUM >= 110000)
+					     ALLOCSET_DEFAULT_SIZES
+#else
+					     ALLOCSET_DEFAULT_MINSIZE,
+					     ALLOCSET_DEFAULT_INITSIZE,
+					     ALLOCSET_DEFAULT_MAXSIZE
+#endif
+					     );
+}
+
+/*
+ * Load batch info and open cursors for events.
+ * Works same way as pgq.batch_event_sql().
+ */
+static void open_batch_cursor(struct BatchState *st, Datum batch_id, bool ordered, MemoryContext ctx)
+{
+	Oid info_types[1] = { INT8OID };
+	Datum values[6];
+	MemoryContext old_ctx;
+	TupleDesc desc;
+	HeapTuple row;
+	Datum *old_txids;
+	int n_old = 0;
+	int64 tx_start, txid, last_xmin, cur_xmax, switch1, switch2, start_id, end_id;
+	bool isnull, switch1_null, switch2_null, start_null, end_null;
+	int res, i, ntables, cur_table, scan;
+	Oid queue_id;
+	int32 sub_id;
+	char *prefix;
+
+	res = SPI_execute_with_args(BATCH_INFO_SQL, 1, info_types, &batch_id, NULL, true, 1);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "pgq.get_batch_events: batch info query failed: %d", res);
+	if (SPI_processed == 0)
+		elog(ERROR, "batch not found");
+	row = SPI_tuptable->vals[0];
+	desc = SPI_tuptable->tupdesc;
+
+	old_ctx = MemoryContextSwitchTo(ctx);
+	st->filter = pgq_txid_filter_create(SPI_getvalue(row, desc, COL_LAST_SNAP),
+					    SPI_getvalue(row, desc, COL_CUR_SNAP));
+	MemoryContextSwitchTo(old_ctx);
+
+	last_xmin = DatumGetInt64(SPI_getbinval(row, desc, COL_LAST_XMIN, &isnull));
+	cur_xmax = DatumGetInt64(SPI_getbinval(row, desc, COL_CUR_XMAX, &isnull));
+	sub_id = DatumGetInt32(SPI_getbinval(row, desc, COL_SUB_ID, &isnull));
+	queue_id = DatumGetInt32(SPI_getbinval(row, desc, COL_QUEUE_ID, &isnull));
+	prefix = SPI_getvalue(row, desc, COL_PREFIX);
+	ntables = DatumGetInt32(SPI_getbinval(row, desc, COL_NTABLES, &isnull));
+	cur_table = DatumGetInt32(SPI_getbinval(row, desc, COL_CUR_TABLE, &isnull));
+	switch1 = DatumGetInt64(SPI_getbinval(row, desc, COL_SWITCH1, &switch1_null));
+	switch2 = DatumGetInt64(SPI_getbinval(row, desc, COL_SWITCH2, &switch2_null));
+	start_id = DatumGetInt64(SPI_getbinval(row, desc, COL_START_ID, &start_null));
+	end_id = DatumGetInt64(SPI_getbinval(row, desc, COL_END_ID, &end_null));
+
+	/*
+	 * Txids that were running at previous tick, but are
+	 * committed in current one.  Ones near range start
+	 * are included in range, rest are looked up by value.
+	 */
+	tx_start = st->filter->range_start;
+	old_txids = palloc((st->filter->n_old + 1) * sizeof(Datum));
+	for (i = st->filter->n_old - 1; i >= 0; i--) {
+		txid = st->filter->old[i];
+		if (tx_start - TXID_RANGE_SLACK <= txid)
+			tx_start = txid;
+		else
+			old_txids[n_old++] = Int64GetDatum(txid);
+	}
+
+	/*
+	 * Tables that may contain events, same as pgq.batch_event_tables().
+	 */
+	if (!switch1_null && cur_xmax < switch1)
+		scan = SCAN_PREV;
+	else if (!switch2_null && last_xmin > switch2)
+		scan = SCAN_NEXT;
+	else
+		scan = SCAN_BOTH;
+
+	values[0] = Int64GetDatum(tx_start);
+	values[1] = Int64GetDatum(cur_xmax);
+	values[2] = Int32GetDatum(sub_id);
+	values[3] = PointerGetDatum(construct_array(old_txids, n_old, INT8OID, sizeof(int64),
+						    FLOAT8PASSBYVAL, 'd'));
+	/* ev_id range of split batch part */
+	values[4] = Int64GetDatum(start_null ? PG_INT64_MIN : start_id);
+	values[5] = Int64GetDatum(end_null ? PG_INT64_MAX : end_id);
+
+	if (!ordered) {
+		open_stream(st, load_batch_plan(queue_id, prefix, ntables, cur_table, scan, false),
+			    values, ctx);
+		return;
+	}
+	if (scan & SCAN_PREV)
+		open_stream(st, load_batch_plan(queue_id, prefix, ntables, cur_table, SCAN_PREV, true),
+			    values, ctx);
+	if (scan & SCAN_NEXT)
+		open_stream(st, load_batch_plan(queue_id, prefix, ntables, cur_table, SCAN_NEXT, true),
+			    values, ctx);
+}
+
+/*
+ * Load next chunk of rows, keeping only rows from transactions
+ * that committed between the ticks.
+ */
+static void fetch_chunk(struct BatchState *st, struct EventStream *s)
+{
+	Datum values[EVENT_NCOLS];
+	bool nulls[EVENT_NCOLS];
+	MemoryContext old_ctx;
+	Portal portal;
+	int64 txid;
+	uint64 i;
+
+	MemoryContextReset(s->chunk_ctx);
+	s->rows = NULL;
+	s->nrows = 0;
+	s->pos = 0;
+
+	if (SPI_connect() < 0)
+		elog(ERROR, "SPI_connect() failed");
+
+	portal = SPI_cursor_find(s->portal_name);
+	if (portal == NULL)
+		elog(ERROR, "pgq.get_batch_events: cursor %s not found", s->portal_name);
+	SPI_cursor_fetch(portal, true, BATCH_FETCH_ROWS);
+	if (SPI_processed < BATCH_FETCH_ROWS)
+		s->eof = true;
+
+	old_ctx = MemoryContextSwitchTo(s->chunk_ctx);
+	s->rows = palloc((SPI_processed + 1) * sizeof(HeapTuple));
+	for (i = 0; i < SPI_processed; i++) {
+		heap_deform_tuple(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, values, nulls);
+		txid = DatumGetInt64(values[COL_TXID]);
+		if (!pgq_txid_filter_match(st->filter, txid))
+			continue;
+		s->rows[s->nrows++] = heap_form_tuple(st->desc, values, nulls);
+	}
+	MemoryContextSwitchTo(old_ctx);
+
+	if (SPI_finish() < 0)
+		elog(ERROR, "SPI_finish() failed");
+}
+
+/*
+ * Return next row, with lowest ev_id from all streams.
+ * Streams are already sorted, so this merges them.
+ */
+static HeapTuple next_event(struct BatchState *st)
+{
+	struct EventStream *s, *best = NULL;
+	int64 ev_id, best_id = 0;
+	bool isnull;
+	int i;
+
+	for (i = 0; i < st->nstreams; i++) {
+		s = &st->streams[i];
+		while (s->pos >= s->nrows && !s->eof)
+			fetch_chunk(st, s);
+		if (s->pos >= s->nrows)
+			continue;
+		ev_id = DatumGetInt64(heap_getattr(s->rows[s->pos], 1, st->desc, &isnull));
+		if (!best || ev_id < best_id) {
+			best = s;
+			best_id = ev_id;
+		}
+	}
+	if (!best)
+		return NULL;
+	return best->rows[best->pos++];
+}
+
+static void close_batch_cursor(Datum arg)
+{
+	struct BatchState *st = (struct BatchState *)DatumGetPointer(arg);
+	Portal portal;
+	int i;
+
+	for (i = 0; i < st->nstreams; i++) {
+		if (!st->streams[i].portal_name)
+			continue;
+		portal = SPI_cursor_find(st->streams[i].portal_name);
+		if (portal)
+			SPI_cursor_close(portal);
+		st->streams[i].portal_name = NULL;
+	}
+}
+
+/*
+ * Return events in batch, in value-per-call mode.
+ *
+ * Rows are read from cursors in chunks, so memory use
+ * does not depend on batch size.  Optional second argument
+ * turns off ev_id ordering.
+ */
+Datum pgq_get_batch_events(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	FuncCallContext *funcctx;
+	struct BatchState *st;
+	MemoryContext old_ctx;
+	TupleDesc desc;
+	HeapTuple row;
+	bool ordered;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		ordered = PG_NARGS() < 2 || PG_ARGISNULL(1) || PG_GETARG_BOOL(1);
+
+		old_ctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		st = palloc0(sizeof(*st));
+		if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		st->desc = BlessTupleDesc(CreateTupleDescCopy(desc));
+		MemoryContextSwitchTo(old_ctx);
+
+		if (SPI_connect() < 0)
+			elog(ERROR, "SPI_connect() failed");
+		open_batch_cursor(st, PG_GETARG_DATUM(0), ordered, funcctx->multi_call_memory_ctx);
+		if (SPI_finish() < 0)
+			elog(ERROR, "SPI_finish() failed");
+
+		/* close cursors if caller stops early */
+		if (rsinfo && IsA(rsinfo, ReturnSetInfo))
+			RegisterExprContextCallback(rsinfo->econtext, close_batch_cursor,
+						    PointerGetDatum(st));
+		funcctx->user_fctx = st;
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	st = funcctx->user_fctx;
+
+	row = next_event(st);
+	if (row)
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(row));
+
+	close_batch_cursor(PointerGetDatum(st));
+	if (rsinfo && IsA(rsinfo, ReturnSetInfo))
+		UnregisterExprContextCallback(rsinfo->econtext, close_batch_cursor,
+					      PointerGetDatum(st));
+	SRF_RETURN_DONE(funcctx);
+}
@@ -21,14 +21,44 @@
 
 #include "access/hash.h"
 #include "catalog/pg_type.h"
+#include "commands/sequence.h"
 #include "commands/trigger.h"
 #include "executor/spi.h"
 #include "lib/stringinfo.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/datetime.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
 #include "access/xact.h"
 
+#include "stats.h"
+#include "wait.h"
+#include "ticker.h"
+
+/*
+ * Insert events directly into table, without executor.
+ */
+#if PG_VERSION_NUM >= 120000
+#define DIRECT_INSERT
+#endif
+
+#ifdef DIRECT_INSERT
+#include "access/genam.h"
+#include "access/table.h"
+#include "access/tableam.h"
+#include "catalog/index.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_class.h"
+#include "executor/tuptable.h"
+#include "nodes/execnodes.h"
+#include "utils/acl.h"
+#include "utils/rel.h"
+#endif
+
 /*
  * Module tag
  */
@@ -40,6 +70,16 @@ PG_MODULE_MAGIC;
 #define TextDatumGetCString(d) DatumGetCString(DirectFunctionCall1(textout, d))
 #endif
 
+#ifndef INT8ARRAYOID
+#define INT8ARRAYOID 1016
+#endif
+
+/* sequence increment is in pg_sequence since 10 */
+#if PG_VERSION_NUM >= 100000
+#include "catalog/pg_sequence.h"
+#define SEQ_IN_CATALOG
+#endif
+
 
 /*
  * Function tag
@@ -47,40 +87,73 @@ PG_MODULE_MAGIC;
 Datum pgq_insert_event_raw(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1(pgq_insert_event_raw);
 
+Datum pgq_insert_event_batch_raw(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_insert_event_batch_raw);
+
+Datum pgq_queue_cache_invalidate(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_queue_cache_invalidate);
+
+void _PG_init(void);
+
 /*
  * Queue info fetching.
- *
- * Always touch ev_id sequence, even if ev_id is given as arg,
- * to notify ticker about new event.
  */
 #define QUEUE_SQL \
 	"select queue_id::int4, queue_data_pfx::text," \
-	" queue_cur_table::int4, nextval(queue_event_seq)::int8," \
+	" queue_cur_table::int4," \
 	" queue_disable_insert::bool," \
-	" queue_per_tx_limit::int4" \
+	" queue_per_tx_limit::int4," \
+	" queue_event_seq::regclass::oid," \
+	" queue_buffer_events::bool" \
 	" from pgq.queue where queue_name = $1"
 #define COL_QUEUE_ID	1
 #define COL_PREFIX	2
 #define COL_TBLNO	3
-#define COL_EVENT_ID	4
-#define COL_DISABLED	5
-#define COL_LIMIT	6
+#define COL_DISABLED	4
+#define COL_LIMIT	5
+#define COL_SEQ_OID	6
+#define COL_BUFFER	7
+
+/*
+ * Support inserting into pgq 3 queues without queue_buffer_events.
+ */
+#define QUEUE_SQL_NOBUF \
+	"select queue_id::int4, queue_data_pfx::text," \
+	" queue_cur_table::int4," \
+	" queue_disable_insert::bool," \
+	" queue_per_tx_limit::int4," \
+	" queue_event_seq::regclass::oid," \
+	" false::bool as queue_buffer_events" \
+	" from pgq.queue where queue_name = $1"
 
 /*
  * Support inserting into pgq 2 queues.
  */
 #define QUEUE_SQL_OLD \
 	"select queue_id::int4, queue_data_pfx::text," \
-	" queue_cur_table::int4, nextval(queue_event_seq)::int8," \
+	" queue_cur_table::int4," \
 	" false::bool as queue_disable_insert," \
-	" null::int4 as queue_per_tx_limit" \
+	" null::int4 as queue_per_tx_limit," \
+	" queue_event_seq::regclass::oid," \
+	" false::bool as queue_buffer_events" \
 	" from pgq.queue where queue_name = $1"
 
 #define QUEUE_CHECK_NEW \
 	"select 1 from pg_catalog.pg_attribute" \
-	" where attname = 'queue_per_tx_limit'" \
+	" where attname in ('queue_per_tx_limit', 'queue_buffer_events')" \
 	" and attrelid = 'pgq.queue'::regclass"
 
+/*
+ * Queue info can be cached only if changes to pgq.queue
+ * are announced by queue_cache_inval trigger.
+ */
+#define QUEUE_CACHE_CHECK \
+	"select c.oid, exists (select 1 from pg_catalog.pg_trigger t" \
+	"   where t.tgrelid = c.oid and t.tgname = 'queue_cache_inval'" \
+	"     and t.tgenabled = 'A')" \
+	" from pg_catalog.pg_class c, pg_catalog.pg_namespace n" \
+	" where n.oid = c.relnamespace and n.nspname = 'pgq' and c.relname = 'queue'"
+
 /*
  * Plan cache entry in HTAB.
  */
@@ -92,8 +165,59 @@ struct InsertCacheEntry {
 	int last_count;
 
 	void *plan;
+	void *batch_plan;
+
+	/* direct insert info, see check_direct_insert() */
+	int direct_state;
+	bool direct_invalid;
+	Oid table_oid;
+	MemoryContext direct_ctx;
+	struct DirectIndexes *indexes;
 };
 
+/*
+ * Indexes to fill on direct insert.
+ */
+struct DirectIndexes {
+	int n_indexes;
+	Oid *index_oids;
+	struct IndexInfo **index_info;
+};
+
+#define DIRECT_UNKNOWN	0
+#define DIRECT_OK	1
+#define DIRECT_NO	2
+
+/*
+ * Queue info cache entry in HTAB.
+ */
+struct QueueCacheEntry {
+	char queue_name[NAMEDATALEN];
+	int queue_id;
+	int cur_table;
+	char *table_prefix;
+	bool disabled;
+	int per_tx_limit;
+	Oid event_seq;
+	bool buffer_events;
+};
+
+/*
+ * Event ids reserved by backend, per event sequence.
+ *
+ * With queue_event_id_block > 1 the sequence increments by
+ * block size and each nextval() reserves ids (value - increment, value],
+ * so sequence stays at highest reserved id.  Ids are handed
+ * out from here without touching the sequence.
+ */
+struct IdBlockEntry {
+	Oid event_seq;
+	int64 next_id;
+	int64 last_id;
+};
+
+static HTAB *id_blocks;
+
 /*
  * helper structure to pass values.
  */
@@ -101,9 +225,10 @@ struct QueueState {
 	int queue_id;
 	int cur_table;
 	char *table_prefix;
-	Datum next_event_id;
 	bool disabled;
 	int per_tx_limit;
+	Oid event_seq;
+	bool buffer_events;
 };
 
 /*
@@ -112,6 +237,22 @@ struct QueueState {
 static void *queue_plan;
 static HTAB *insert_cache;
 
+/*
+ * Queue info cache.
+ */
+static bool queue_cache_invalid = true;
+static bool queue_cache_enabled;
+static Oid queue_table_oid;
+static MemoryContext queue_cache_ctx;
+static HTAB *queue_cache;
+
+static void relcache_reset_cb(Datum arg, Oid relid);
+#ifdef DIRECT_INSERT
+static void event_buffer_xact_cb(XactEvent event, void *arg);
+static void event_buffer_subxact_cb(SubXactEvent event, SubTransactionId mySubid,
+				    SubTransactionId parentSubid, void *arg);
+#endif
+
 /*
  * Prepare utility plans and plan cache.
  */
@@ -129,7 +270,8 @@ static void init_cache(void)
 		return;
 
 	/*
-	 * Check if old (v2.x) or new (v3.x) queue table.
+	 * Check if old (v2.x) or new (v3.x) queue table,
+	 * and if it has queue_buffer_events.
 	 *
 	 * Needed for upgrades.
 	 */
@@ -137,8 +279,10 @@ static void init_cache(void)
 	if (res < 0)
 		elog(ERROR, "pgq.insert_event: QUEUE_CHECK_NEW failed");
 
-	if (SPI_processed > 0) {
+	if (SPI_processed > 1) {
 		sql = QUEUE_SQL;
+	} else if (SPI_processed > 0) {
+		sql = QUEUE_SQL_NOBUF;
 	} else {
 		sql = QUEUE_SQL_OLD;
 	}
@@ -160,9 +304,112 @@ static void init_cache(void)
 	flags = HASH_ELEM | HASH_FUNCTION;
 	insert_cache = hash_create("pgq_insert_raw plans cache", max_queues, &ctl, flags);
 
+	CacheRegisterRelcacheCallback(relcache_reset_cb, (Datum)0);
+#ifdef DIRECT_INSERT
+	RegisterXactCallback(event_buffer_xact_cb, NULL);
+	RegisterSubXactCallback(event_buffer_subxact_cb, NULL);
+#endif
+
 	init_done = 1;
 }
 
+/*
+ * The callback can be launched any time from signal callback,
+ * only minimal tagging can be done here.
+ */
+static void relcache_reset_cb(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS seq;
+	struct InsertCacheEntry *entry;
+	struct IdBlockEntry *blk;
+
+	if (relid == InvalidOid || relid == queue_table_oid || queue_table_oid == InvalidOid)
+		queue_cache_invalid = true;
+
+	/*
+	 * Sequence may be dropped and its oid reused, forget block.
+	 * Also forget all blocks on queue change, so ids reserved
+	 * before rotation or block size change are not used later,
+	 * when ticker does not look for them.
+	 */
+	if (id_blocks) {
+		hash_seq_init(&seq, id_blocks);
+		while ((blk = hash_seq_search(&seq)) != NULL) {
+			if (relid == InvalidOid || relid == blk->event_seq
+			    || relid == queue_table_oid || queue_table_oid == InvalidOid)
+				blk->last_id = blk->next_id - 1;
+		}
+	}
+
+	if (!insert_cache)
+		return;
+	hash_seq_init(&seq, insert_cache);
+	while ((entry = hash_seq_search(&seq)) != NULL) {
+		if (relid == InvalidOid || relid == entry->table_oid)
+			entry->direct_invalid = true;
+	}
+}
+
+/*
+ * Drop all cached queue info and check if it can be cached again.
+ */
+static void reset_queue_cache(void)
+{
+	HASHCTL ctl;
+	int flags;
+	int res;
+	int max_queues = 128;
+	TupleDesc desc;
+	HeapTuple row;
+	bool isnull;
+
+	if (queue_cache)
+		hash_destroy(queue_cache);
+	if (queue_cache_ctx)
+		MemoryContextDelete(queue_cache_ctx);
+	queue_cache = NULL;
+	queue_cache_ctx = NULL;
+	queue_cache_enabled = false;
+	queue_table_oid = InvalidOid;
+
+	/* new reset during the check below must not get lost */
+	queue_cache_invalid = false;
+
+	res = SPI_execute(QUEUE_CACHE_CHECK, 1, 0);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "pgq.insert_event: QUEUE_CACHE_CHECK failed");
+	if (SPI_processed == 0)
+		return;
+
+	row = SPI_tuptable->vals[0];
+	desc = SPI_tuptable->tupdesc;
+	queue_table_oid = DatumGetObjectId(SPI_getbinval(row, desc, 1, &isnull));
+	if (!DatumGetBool(SPI_getbinval(row, desc, 2, &isnull)))
+		return;
+
+	queue_cache_ctx = AllocSetContextCreate(TopMemoryContext,
+						"pgq_insert_raw queue info",
+#if (PG_VERSION_NUM >= 110000)
+						ALLOCSET_SMALL_SIZES
+#else
+						ALLOCSET_SMALL_MINSIZE,
+						ALLOCSET_SMALL_INITSIZE,
+						ALLOCSET_SMALL_MAXSIZE
+#endif
+						);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = NAMEDATALEN;
+	ctl.entrysize = sizeof(struct QueueCacheEntry);
+	ctl.hcxt = queue_cache_ctx;
+	flags = HASH_ELEM | HASH_CONTEXT;
+#if PG_VERSION_NUM >= 140000
+	flags |= HASH_STRINGS;
+#endif
+	queue_cache = hash_create("pgq_insert_raw queue cache", max_queues, &ctl, flags);
+	queue_cache_enabled = true;
+}
+
 /*
  * Create new plan for insertion into current queue table.
  */
@@ -191,29 +438,82 @@ static void *make_plan(struct QueueState *state)
 }
 
 /*
- * fetch insert plan from cache.
+ * Create new plan for multi-row insertion into current queue table.
+ *
+ * All rows are passed in as arrays and unpacked with unnest(),
+ * so whole batch goes through single executor run.
+ */
+static void *make_batch_plan(struct QueueState *state)
+{
+	void *plan;
+	StringInfo sql;
+	static Oid types[8] = {
+		INT8ARRAYOID, TIMESTAMPTZOID, TEXTARRAYOID, TEXTARRAYOID,
+		TEXTARRAYOID, TEXTARRAYOID, TEXTARRAYOID, TEXTARRAYOID
+	};
+
+	/*
+	 * create sql
+	 */
+	sql = makeStringInfo();
+	appendStringInfo(sql, "insert into %s_%d (ev_id, ev_time, ev_owner, ev_retry,"
+			 " ev_type, ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4)"
+			 " select ev.ev_id, $2, null, null, ev.ev_type, ev.ev_data,"
+			 " ev.ev_extra1, ev.ev_extra2, ev.ev_extra3, ev.ev_extra4"
+			 " from unnest($1, $3, $4, $5, $6, $7, $8)"
+			 " as ev (ev_id, ev_type, ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4)",
+			 state->table_prefix, state->cur_table);
+	/*
+	 * create plan
+	 */
+	plan = SPI_prepare(sql->data, 8, types);
+	return SPI_saveplan(plan);
+}
+
+/*
+ * forget direct insert info.
  */
-static void *load_insert_plan(Datum qname, struct QueueState *state)
+static void free_direct_info(struct InsertCacheEntry *entry)
+{
+	if (entry->direct_ctx)
+		MemoryContextDelete(entry->direct_ctx);
+	entry->direct_ctx = NULL;
+	entry->direct_state = DIRECT_UNKNOWN;
+	entry->direct_invalid = false;
+	entry->table_oid = InvalidOid;
+	entry->indexes = NULL;
+}
+
+/*
+ * fetch plan cache entry for current queue table.
+ *
+ * Also checks per-tx limit, count is number of events
+ * that are going to be inserted.
+ */
+static struct InsertCacheEntry *load_insert_cache(Datum qname, struct QueueState *state, int count)
 {
 	struct InsertCacheEntry *entry;
 	Oid queue_id = state->queue_id;
 	bool did_exist = false;
 
 	entry = hash_search(insert_cache, &queue_id, HASH_ENTER, &did_exist);
-	if (did_exist) {
-		if (entry->plan && state->cur_table == entry->cur_table)
-			goto valid_table;
-		if (entry->plan)
-			SPI_freeplan(entry->plan);
-	}
-
-	entry->cur_table = state->cur_table;
-	entry->last_xid = 0;
-	entry->plan = NULL;
+	if (!did_exist || state->cur_table != entry->cur_table) {
+		if (did_exist) {
+			if (entry->plan)
+				SPI_freeplan(entry->plan);
+			if (entry->batch_plan)
+				SPI_freeplan(entry->batch_plan);
+			free_direct_info(entry);
+		} else {
+			entry->direct_ctx = NULL;
+			free_direct_info(entry);
+		}
 
-	/* this can fail, struct must be valid before */
-	entry->plan = make_plan(state);
-valid_table:
+		entry->cur_table = state->cur_table;
+		entry->last_xid = 0;
+		entry->plan = NULL;
+		entry->batch_plan = NULL;
+	}
 
 	if (state->per_tx_limit >= 0) {
 		TransactionId xid = GetTopTransactionId();
@@ -221,19 +521,514 @@ valid_table:
 			entry->last_xid = xid;
 			entry->last_count = 0;
 		}
-		entry->last_count++;
-		if (entry->last_count > state->per_tx_limit)
+		entry->last_count += count;
+		if (entry->last_count > state->per_tx_limit) {
+			pgq_stat_reject(state->queue_id, PGQ_STAT_REJECT_TX_LIMIT);
 			elog(ERROR, "Queue '%s' allows max %d events from one TX",
 			     TextDatumGetCString(qname), state->per_tx_limit);
+		}
 	}
 
+	return entry;
+}
+
+/*
+ * fetch insert plan from cache.
+ */
+static void *load_insert_plan(struct InsertCacheEntry *entry, struct QueueState *state)
+{
+	if (!entry->plan)
+		entry->plan = make_plan(state);
 	return entry->plan;
 }
 
+/*
+ * fetch multi-row insert plan from cache.
+ */
+static void *load_batch_plan(struct InsertCacheEntry *entry, struct QueueState *state)
+{
+	if (!entry->batch_plan)
+		entry->batch_plan = make_batch_plan(state);
+	return entry->batch_plan;
+}
+
+#ifdef DIRECT_INSERT
+
+/*
+ * Expected layout of event table, same as pgq.event_template.
+ */
+static const struct EventColumn {
+	const char *name;
+	Oid type;
+} event_columns[] = {
+	{ "ev_id", INT8OID },
+	{ "ev_time", TIMESTAMPTZOID },
+	{ "ev_txid", INT8OID },
+	{ "ev_owner", INT4OID },
+	{ "ev_retry", INT4OID },
+	{ "ev_type", TEXTOID },
+	{ "ev_data", TEXTOID },
+	{ "ev_extra1", TEXTOID },
+	{ "ev_extra2", TEXTOID },
+	{ "ev_extra3", TEXTOID },
+	{ "ev_extra4", TEXTOID },
+};
+#define EV_NCOLS lengthof(event_columns)
+
+/*
+ * Check if table can be filled without executor:
+ * standard layout, nothing that executor would need to run.
+ */
+static bool check_direct_table(Relation rel)
+{
+	TupleDesc desc = RelationGetDescr(rel);
+	Form_pg_attribute attr;
+	int i;
+
+	if (rel->rd_rel->relkind != RELKIND_RELATION || rel->rd_rel->relispartition)
+		return false;
+	if (rel->trigdesc || rel->rd_rel->relrowsecurity)
+		return false;
+	if (desc->natts != EV_NCOLS)
+		return false;
+	if (desc->constr && (desc->constr->num_check > 0 || desc->constr->has_generated_stored))
+		return false;
+
+	for (i = 0; i < EV_NCOLS; i++) {
+		attr = TupleDescAttr(desc, i);
+		if (attr->attisdropped || attr->atttypid != event_columns[i].type)
+			return false;
+		if (strcmp(NameStr(attr->attname), event_columns[i].name) != 0)
+			return false;
+		/* first 3 columns are always filled */
+		if (attr->attnotnull && i >= 3)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Load indexes of table, only plain btree indexes are supported.
+ *
+ * Result is allocated in CurrentMemoryContext.
+ */
+static struct DirectIndexes *load_direct_indexes(Relation rel)
+{
+	struct DirectIndexes *res;
+	List *index_list;
+	ListCell *lc;
+	bool ok = true;
+
+	index_list = RelationGetIndexList(rel);
+
+	res = palloc0(sizeof(*res));
+	res->index_oids = palloc(Max(list_length(index_list), 1) * sizeof(Oid));
+	res->index_info = palloc(Max(list_length(index_list), 1) * sizeof(IndexInfo *));
+
+	foreach(lc, index_list) {
+		Oid index_oid = lfirst_oid(lc);
+		Relation irel;
+		IndexInfo *info;
+
+		irel = index_open(index_oid, RowExclusiveLock);
+		info = BuildIndexInfo(irel);
+		if (irel->rd_rel->relam != BTREE_AM_OID
+		    || info->ii_Expressions != NIL
+		    || info->ii_Predicate != NIL
+		    || info->ii_ExclusionOps != NULL
+		    || (info->ii_Unique && !irel->rd_index->indimmediate))
+			ok = false;
+		index_close(irel, NoLock);
+		if (!ok)
+			break;
+
+		res->index_oids[res->n_indexes] = index_oid;
+		res->index_info[res->n_indexes] = info;
+		res->n_indexes++;
+	}
+
+	list_free(index_list);
+	return ok ? res : NULL;
+}
+
+/*
+ * Add index entries for inserted row.
+ */
+static void insert_index_entries(Relation rel, struct DirectIndexes *indexes, TupleTableSlot *slot)
+{
+	Datum ivalues[INDEX_MAX_KEYS];
+	bool iisnull[INDEX_MAX_KEYS];
+	int i;
+
+	for (i = 0; i < indexes->n_indexes; i++) {
+		IndexInfo *info = indexes->index_info[i];
+		Relation irel;
+
+		if (!info->ii_ReadyForInserts)
+			continue;
+
+		irel = index_open(indexes->index_oids[i], RowExclusiveLock);
+		FormIndexDatum(info, slot, NULL, ivalues, iisnull);
+		index_insert(irel, ivalues, iisnull, &slot->tts_tid, rel,
+			     info->ii_Unique ? UNIQUE_CHECK_YES : UNIQUE_CHECK_NO,
+#if PG_VERSION_NUM >= 140000
+			     false,
+#endif
+			     info);
+		index_close(irel, NoLock);
+	}
+}
+
+/*
+ * Find out if current queue table can be used for direct insert.
+ */
+static void check_direct_insert(struct InsertCacheEntry *entry, struct QueueState *state)
+{
+	MemoryContext old_ctx;
+	char *name;
+	List *names;
+	Oid relid;
+	Relation rel;
+
+	free_direct_info(entry);
+
+	name = psprintf("%s_%d", state->table_prefix, state->cur_table);
+#if PG_VERSION_NUM >= 160000
+	names = stringToQualifiedNameList(name, NULL);
+#else
+	names = stringToQualifiedNameList(name);
+#endif
+	relid = RangeVarGetRelid(makeRangeVarFromNameList(names), NoLock, true);
+	if (!OidIsValid(relid))
+		return;
+
+	/* invalidations from here on must not get lost */
+	entry->table_oid = relid;
+
+	rel = table_open(relid, RowExclusiveLock);
+	if (check_direct_table(rel)) {
+		entry->direct_ctx = AllocSetContextCreate(TopMemoryContext,
+							  "pgq_insert_raw direct insert",
+							  ALLOCSET_SMALL_SIZES);
+		old_ctx = MemoryContextSwitchTo(entry->direct_ctx);
+		entry->indexes = load_direct_indexes(rel);
+		MemoryContextSwitchTo(old_ctx);
+	}
+	table_close(rel, NoLock);
+
+	entry->direct_state = entry->indexes ? DIRECT_OK : DIRECT_NO;
+}
+
+/*
+ * Check if current queue table can be used for direct insert.
+ */
+static bool direct_usable(struct InsertCacheEntry *entry, struct QueueState *state)
+{
+	if (entry->direct_invalid)
+		free_direct_info(entry);
+	if (entry->direct_state == DIRECT_UNKNOWN)
+		check_direct_insert(entry, state);
+	return entry->direct_state == DIRECT_OK;
+}
+
+/*
+ * Open current queue table for direct insert.
+ *
+ * Returns NULL if table was changed or dropped meanwhile
+ * or user cannot insert into it, then executor must handle it.
+ */
+static Relation direct_open(struct InsertCacheEntry *entry)
+{
+	Relation rel;
+
+	rel = try_table_open(entry->table_oid, RowExclusiveLock);
+	if (rel == NULL)
+		return NULL;
+	if (entry->direct_invalid
+	    || pg_class_aclcheck(RelationGetRelid(rel), GetUserId(), ACL_INSERT) != ACLCHECK_OK) {
+		table_close(rel, NoLock);
+		return NULL;
+	}
+	return rel;
+}
+
+/*
+ * Fill row from insert plan values, they do not contain ev_txid.
+ */
+static void fill_event_slot(TupleTableSlot *slot, Datum *values, char *nulls)
+{
+	int i;
+
+	ExecClearTuple(slot);
+	for (i = 0; i < EV_NCOLS; i++) {
+		int src = (i < 2) ? i : i - 1;
+		if (i == 2) {
+			slot->tts_values[i] = Int64GetDatum((int64)U64FromFullTransactionId(GetTopFullTransactionId()));
+			slot->tts_isnull[i] = false;
+		} else {
+			slot->tts_values[i] = values[src];
+			slot->tts_isnull[i] = (nulls[src] == 'n');
+		}
+	}
+	ExecStoreVirtualTuple(slot);
+}
+
+/*
+ * Insert event into current queue table, bypassing executor.
+ *
+ * Takes same values as insert plan.  Returns false if
+ * the table cannot be used that way, then normal plan
+ * must be used.
+ */
+static bool direct_insert(struct InsertCacheEntry *entry, struct QueueState *state,
+			  Datum *values, char *nulls)
+{
+	Relation rel;
+	TupleTableSlot *slot;
+
+	if (!direct_usable(entry, state))
+		return false;
+	rel = direct_open(entry);
+	if (rel == NULL)
+		return false;
+
+	slot = table_slot_create(rel, NULL);
+	fill_event_slot(slot, values, nulls);
+
+	table_tuple_insert(rel, slot, GetCurrentCommandId(true), 0, NULL);
+	insert_index_entries(rel, entry->indexes, slot);
+
+	ExecDropSingleTupleTableSlot(slot);
+	table_close(rel, NoLock);
+	return true;
+}
+
+/*
+ * Transaction-level event buffer.
+ *
+ * For queues with queue_buffer_events set, events are collected
+ * in memory and written with table_multi_insert() at commit,
+ * or when EVENT_BUFFER_FLUSH rows have piled up.
+ *
+ * Rows are always written in the (sub)transaction that created them:
+ * rows of a subtransaction are flushed when it commits and dropped
+ * when it aborts.  So rows in buffer are ordered by subxact id,
+ * with rows of current subtransaction at the end.
+ */
+#define EVENT_BUFFER_FLUSH 1000
+
+struct BufferedEvent {
+	TupleTableSlot *slot;
+	SubTransactionId subid;
+};
+
+struct EventBuffer {
+	struct EventBuffer *next;
+	Oid table_oid;
+	TupleDesc desc;
+	int count;
+	int alloc;
+	struct BufferedEvent *events;
+
+	/* where rows of level_subid start */
+	SubTransactionId level_subid;
+	int level_start;
+};
+
+static MemoryContext event_buffer_ctx;
+static struct EventBuffer *event_buffer_list;
+
+/*
+ * Write out buffered rows, starting from position pos.
+ */
+static void flush_event_buffer(struct EventBuffer *buf, int pos)
+{
+	MemoryContext old_ctx;
+	Relation rel;
+	struct DirectIndexes *indexes = NULL;
+	TupleTableSlot **slots;
+	int i, n = buf->count - pos;
+
+	if (n <= 0)
+		return;
+
+	old_ctx = MemoryContextSwitchTo(event_buffer_ctx);
+
+	/* table may have changed after rows were added, recheck */
+	rel = table_open(buf->table_oid, RowExclusiveLock);
+	if (check_direct_table(rel))
+		indexes = load_direct_indexes(rel);
+	if (!indexes)
+		elog(ERROR, "pgq: event table \"%s\" was changed, cannot write buffered events",
+		     RelationGetRelationName(rel));
+
+	slots = palloc(n * sizeof(TupleTableSlot *));
+	for (i = 0; i < n; i++)
+		slots[i] = buf->events[pos + i].slot;
+
+	table_multi_insert(rel, slots, n, GetCurrentCommandId(true), 0, NULL);
+	for (i = 0; i < n; i++) {
+		insert_index_entries(rel, indexes, slots[i]);
+		ExecDropSingleTupleTableSlot(slots[i]);
+	}
+	buf->count = pos;
+
+	table_close(rel, NoLock);
+	pfree(slots);
+	MemoryContextSwitchTo(old_ctx);
+}
+
+/*
+ * Add event to transaction buffer.
+ *
+ * Takes same values as insert plan.  Returns false if
+ * the table cannot be used that way, then normal plan
+ * must be used.
+ */
+static bool buffer_event(struct InsertCacheEntry *entry, struct QueueState *state,
+			 Datum *values, char *nulls)
+{
+	struct EventBuffer *buf;
+	struct BufferedEvent *ev;
+	MemoryContext old_ctx;
+	SubTransactionId subid = GetCurrentSubTransactionId();
+	Relation rel;
+
+	if (!direct_usable(entry, state))
+		return false;
+
+	/* keeps table locked until commit */
+	rel = direct_open(entry);
+	if (rel == NULL)
+		return false;
+
+	if (!event_buffer_ctx)
+		event_buffer_ctx = AllocSetContextCreate(TopTransactionContext,
+							 "pgq event buffer",
+							 ALLOCSET_DEFAULT_SIZES);
+	old_ctx = MemoryContextSwitchTo(event_buffer_ctx);
+
+	for (buf = event_buffer_list; buf; buf = buf->next) {
+		if (buf->table_oid == entry->table_oid)
+			break;
+	}
+	if (!buf) {
+		buf = palloc0(sizeof(*buf));
+		buf->table_oid = entry->table_oid;
+		buf->desc = CreateTupleDescCopy(RelationGetDescr(rel));
+		buf->alloc = 64;
+		buf->events = palloc(buf->alloc * sizeof(struct BufferedEvent));
+		buf->next = event_buffer_list;
+		event_buffer_list = buf;
+	} else if (buf->count >= buf->alloc) {
+		buf->alloc *= 2;
+		buf->events = repalloc(buf->events, buf->alloc * sizeof(struct BufferedEvent));
+	}
+
+	/* copy values to buffer memory */
+	ev = &buf->events[buf->count];
+	ev->subid = subid;
+	ev->slot = MakeSingleTupleTableSlot(buf->desc, table_slot_callbacks(rel));
+	fill_event_slot(ev->slot, values, nulls);
+	ExecMaterializeSlot(ev->slot);
+	buf->count++;
+
+	MemoryContextSwitchTo(old_ctx);
+	table_close(rel, NoLock);
+
+	/* write out current subtransaction rows if there are too many */
+	if (buf->level_subid != subid) {
+		buf->level_subid = subid;
+		for (buf->level_start = buf->count - 1; buf->level_start > 0; buf->level_start--) {
+			if (buf->events[buf->level_start - 1].subid != subid)
+				break;
+		}
+	}
+	if (buf->count - buf->level_start >= EVENT_BUFFER_FLUSH)
+		flush_event_buffer(buf, buf->level_start);
+
+	return true;
+}
+
+/*
+ * Write out or forget rows of current (sub)transaction.
+ */
+static void finish_event_buffer(SubTransactionId subid, bool commit)
+{
+	struct EventBuffer *buf;
+	int i, first;
+
+	for (buf = event_buffer_list; buf; buf = buf->next) {
+		for (first = buf->count; first > 0; first--) {
+			if (buf->events[first - 1].subid < subid)
+				break;
+		}
+		if (commit) {
+			flush_event_buffer(buf, first);
+		} else {
+			for (i = first; i < buf->count; i++)
+				ExecDropSingleTupleTableSlot(buf->events[i].slot);
+			buf->count = first;
+		}
+	}
+}
+
+static void event_buffer_xact_cb(XactEvent event, void *arg)
+{
+	switch (event) {
+	case XACT_EVENT_PRE_COMMIT:
+	case XACT_EVENT_PRE_PREPARE:
+		finish_event_buffer(InvalidSubTransactionId, true);
+		break;
+	case XACT_EVENT_COMMIT:
+	case XACT_EVENT_ABORT:
+	case XACT_EVENT_PREPARE:
+	case XACT_EVENT_PARALLEL_COMMIT:
+	case XACT_EVENT_PARALLEL_ABORT:
+		/* memory is released with TopTransactionContext */
+		event_buffer_ctx = NULL;
+		event_buffer_list = NULL;
+		break;
+	default:
+		break;
+	}
+}
+
+static void event_buffer_subxact_cb(SubXactEvent event, SubTransactionId mySubid,
+				    SubTransactionId parentSubid, void *arg)
+{
+	switch (event) {
+	case SUBXACT_EVENT_PRE_COMMIT_SUB:
+		finish_event_buffer(mySubid, true);
+		break;
+	case SUBXACT_EVENT_ABORT_SUB:
+		finish_event_buffer(mySubid, false);
+		break;
+	default:
+		break;
+	}
+}
+
+#else /* !DIRECT_INSERT */
+
+static bool direct_insert(struct InsertCacheEntry *entry, struct QueueState *state,
+			  Datum *values, char *nulls)
+{
+	return false;
+}
+
+static bool buffer_event(struct InsertCacheEntry *entry, struct QueueState *state,
+			 Datum *values, char *nulls)
+{
+	return false;
+}
+
+#endif
+
 /*
  * load queue info from pgq.queue table.
  */
-static void load_queue_info(Datum queue_name, struct QueueState *state)
+static void fetch_queue_info(Datum queue_name, struct QueueState *state)
 {
 	Datum values[1];
 	int res;
@@ -259,15 +1054,158 @@ static void load_queue_info(Datum queue_name, struct QueueState *state)
 	state->table_prefix = SPI_getvalue(row, desc, COL_PREFIX);
 	if (state->table_prefix == NULL)
 		elog(ERROR, "table prefix NULL");
-	state->next_event_id = SPI_getbinval(row, desc, COL_EVENT_ID, &isnull);
-	if (isnull)
-		elog(ERROR, "Seq name NULL");
 	state->disabled = SPI_getbinval(row, desc, COL_DISABLED, &isnull);
 	if (isnull)
 		elog(ERROR, "insert_disabled NULL");
 	state->per_tx_limit = SPI_getbinval(row, desc, COL_LIMIT, &isnull);
 	if (isnull)
 		state->per_tx_limit = -1;
+	state->event_seq = DatumGetObjectId(SPI_getbinval(row, desc, COL_SEQ_OID, &isnull));
+	if (isnull)
+		elog(ERROR, "Seq name NULL");
+	state->buffer_events = DatumGetBool(SPI_getbinval(row, desc, COL_BUFFER, &isnull));
+	if (isnull)
+		state->buffer_events = false;
+}
+
+/*
+ * load queue info, from cache if possible.
+ */
+static void load_queue_info(Datum queue_name, struct QueueState *state)
+{
+	struct QueueCacheEntry *entry = NULL;
+	char *qname = NULL;
+	bool found = false;
+
+	/*
+	 * Make committed changes to pgq.queue visible,
+	 * as the SELECT would have done.
+	 */
+	AcceptInvalidationMessages();
+	if (queue_cache_invalid)
+		reset_queue_cache();
+
+	if (queue_cache_enabled) {
+		qname = TextDatumGetCString(queue_name);
+		if (strlen(qname) < NAMEDATALEN)
+			entry = hash_search(queue_cache, qname, HASH_FIND, &found);
+	}
+
+	if (found) {
+		state->queue_id = entry->queue_id;
+		state->cur_table = entry->cur_table;
+		state->table_prefix = entry->table_prefix;
+		state->disabled = entry->disabled;
+		state->per_tx_limit = entry->per_tx_limit;
+		state->event_seq = entry->event_seq;
+		state->buffer_events = entry->buffer_events;
+	} else {
+		fetch_queue_info(queue_name, state);
+
+		/*
+		 * Store only if there was no reset meanwhile.  With transaction
+		 * snapshot the row may be older than committed changes, and
+		 * later transactions would keep using it.
+		 */
+		if (queue_cache_enabled && !queue_cache_invalid && !IsolationUsesXactSnapshot()
+		    && strlen(qname) < NAMEDATALEN) {
+			char *prefix = MemoryContextStrdup(queue_cache_ctx, state->table_prefix);
+			entry = hash_search(queue_cache, qname, HASH_ENTER, &found);
+			entry->queue_id = state->queue_id;
+			entry->cur_table = state->cur_table;
+			entry->table_prefix = prefix;
+			entry->disabled = state->disabled;
+			entry->per_tx_limit = state->per_tx_limit;
+			entry->event_seq = state->event_seq;
+			entry->buffer_events = state->buffer_events;
+		}
+	}
+}
+
+static int64 seq_increment(Oid seq)
+{
+#ifdef SEQ_IN_CATALOG
+	HeapTuple tup;
+	int64 incr;
+
+	tup = SearchSysCache1(SEQRELID, ObjectIdGetDatum(seq));
+	if (!HeapTupleIsValid(tup))
+		elog(ERROR, "cache lookup failed for sequence %u", seq);
+	incr = ((Form_pg_sequence) GETSTRUCT(tup))->seqincrement;
+	ReleaseSysCache(tup);
+	return incr;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * Take count event ids from backend's block, reserving
+ * new block with single nextval() when it runs out.
+ */
+static void reserve_event_ids(Oid event_seq, Datum *ids, int count)
+{
+	struct IdBlockEntry *blk;
+	HASHCTL ctl;
+	bool found;
+	int64 value, incr;
+	int i;
+
+	if (!id_blocks) {
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(struct IdBlockEntry);
+		ctl.hash = oid_hash;
+		id_blocks = hash_create("pgq event id blocks", 128, &ctl, HASH_ELEM | HASH_FUNCTION);
+	}
+
+	blk = hash_search(id_blocks, &event_seq, HASH_ENTER, &found);
+	if (!found) {
+		blk->next_id = 1;
+		blk->last_id = 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (blk->next_id > blk->last_id) {
+			/*
+			 * Increment is read after nextval(), ALTER SEQUENCE
+			 * cannot run in between as nextval() locks the sequence
+			 * until end of transaction.
+			 */
+			value = DatumGetInt64(DirectFunctionCall1(nextval_oid, ObjectIdGetDatum(event_seq)));
+			incr = seq_increment(event_seq);
+			if (incr < 1)
+				incr = 1;
+			blk->last_id = value;
+			blk->next_id = value - incr + 1;
+			/* first value of sequence is its start */
+			if (blk->next_id < 1)
+				blk->next_id = 1;
+		}
+		ids[i] = Int64GetDatum(blk->next_id++);
+	}
+}
+
+/*
+ * Check if queue has disable_insert flag set.
+ */
+static void check_insert_allowed(struct QueueState *state)
+{
+#if defined(PG_VERSION_NUM) && PG_VERSION_NUM >= 80300
+	/* 8.3+: allow insert_event() even if connection is in 'replica' role */
+	if (state->disabled) {
+		if (SessionReplicationRole != SESSION_REPLICATION_ROLE_REPLICA) {
+			pgq_stat_reject(state->queue_id, PGQ_STAT_REJECT_DISABLED);
+			elog(ERROR, "Insert into queue disallowed");
+		}
+	}
+#else
+	/* pre-8.3 */
+	if (state->disabled) {
+		pgq_stat_reject(state->queue_id, PGQ_STAT_REJECT_DISABLED);
+		elog(ERROR, "Insert into queue disallowed");
+	}
+#endif
 }
 
 /*
@@ -289,11 +1227,15 @@ Datum pgq_insert_event_raw(PG_FUNCTION_ARGS)
 	Datum values[11];
 	char nulls[11];
 	struct QueueState state;
+	struct InsertCacheEntry *entry;
 	int64 ret_id;
 	void *ins_plan;
 	Datum ev_id, ev_time;
 	int i, res;
 	Datum qname;
+	bool do_stats;
+	instr_time start;
+	int64 ev_size = 0;
 
 	if (PG_NARGS() < 6)
 		elog(ERROR, "Need at least 6 arguments");
@@ -301,6 +1243,10 @@ Datum pgq_insert_event_raw(PG_FUNCTION_ARGS)
 		elog(ERROR, "Queue name must not be NULL");
 	qname = PG_GETARG_DATUM(0);
 
+	do_stats = pgq_stat_enabled();
+	if (do_stats)
+		INSTR_TIME_SET_CURRENT(start);
+
 	if (SPI_connect() < 0)
 		elog(ERROR, "SPI_connect() failed");
 
@@ -308,25 +1254,18 @@ Datum pgq_insert_event_raw(PG_FUNCTION_ARGS)
 
 	load_queue_info(qname, &state);
 
-	/*
-	 * Check if queue has disable_insert flag set.
-	 */
-#if defined(PG_VERSION_NUM) && PG_VERSION_NUM >= 80300
-	/* 8.3+: allow insert_event() even if connection is in 'replica' role */
-	if (state.disabled) {
-		if (SessionReplicationRole != SESSION_REPLICATION_ROLE_REPLICA)
-			elog(ERROR, "Insert into queue disallowed");
-	}
-#else
-	/* pre-8.3 */
-	if (state.disabled)
-		elog(ERROR, "Insert into queue disallowed");
-#endif
+	check_insert_allowed(&state);
 
-	if (PG_ARGISNULL(1))
-		ev_id = state.next_event_id;
-	else
+	if (PG_ARGISNULL(1)) {
+		reserve_event_ids(state.event_seq, &ev_id, 1);
+	} else {
+		/*
+		 * Always touch ev_id sequence, even if ev_id is given as arg,
+		 * to notify ticker about new event.  Retried events come here.
+		 */
+		DirectFunctionCall1(nextval_oid, ObjectIdGetDatum(state.event_seq));
 		ev_id = PG_GETARG_DATUM(1);
+	}
 
 	if (PG_ARGISNULL(2))
 		ev_time = DirectFunctionCall1(now, 0);
@@ -348,24 +1287,214 @@ Datum pgq_insert_event_raw(PG_FUNCTION_ARGS)
 		} else {
 			values[dst] = PG_GETARG_DATUM(i);
 			nulls[dst] = ' ';
+			if (do_stats && i >= 5)
+				ev_size += pgq_stat_datum_size(values[dst]);
 		}
 	}
 
 	/*
 	 * Perform INSERT into queue table.
 	 */
-	ins_plan = load_insert_plan(qname, &state);
-	res = SPI_execute_plan(ins_plan, values, nulls, false, 0);
-	if (res != SPI_OK_INSERT)
-		elog(ERROR, "Queue insert failed");
+	entry = load_insert_cache(qname, &state, 1);
+	if (state.buffer_events && buffer_event(entry, &state, values, nulls)) {
+		/* written at commit */
+	} else if (!direct_insert(entry, &state, values, nulls)) {
+		ins_plan = load_insert_plan(entry, &state);
+		res = SPI_execute_plan(ins_plan, values, nulls, false, 0);
+		if (res != SPI_OK_INSERT)
+			elog(ERROR, "Queue insert failed");
+	}
 
 	/*
 	 * ev_id cannot pass SPI_finish()
 	 */
 	ret_id = DatumGetInt64(ev_id);
 
+	if (do_stats)
+		pgq_stat_insert(state.queue_id, 1, ev_size, ev_size, &start);
+
 	if (SPI_finish() < 0)
 		elog(ERROR, "SPI_finish failed");
 
 	PG_RETURN_INT64(ret_id);
 }
+
+/*
+ * Check that batch argument is usable and return its length.
+ * NULL array is taken as array of NULLs.
+ */
+static int batch_array_length(FunctionCallInfo fcinfo, int argno)
+{
+	ArrayType *arr;
+
+	if (argno >= PG_NARGS() || PG_ARGISNULL(argno))
+		return -1;
+	arr = PG_GETARG_ARRAYTYPE_P(argno);
+	if (ARR_NDIM(arr) > 1)
+		elog(ERROR, "Batch arrays must be one-dimensional");
+	return ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr));
+}
+
+/*
+ * Add up event sizes in batch for stats.
+ */
+static void batch_stat_sizes(FunctionCallInfo fcinfo, int count, int64 *total, int64 *max_size)
+{
+	int64 *sizes;
+	Datum *elems;
+	bool *elem_nulls;
+	int i, j, n;
+
+	sizes = palloc0(count * sizeof(int64));
+	for (i = 1; i < 7; i++) {
+		if (i >= PG_NARGS() || PG_ARGISNULL(i))
+			continue;
+		deconstruct_array(PG_GETARG_ARRAYTYPE_P(i), TEXTOID, -1, false, 'i',
+				  &elems, &elem_nulls, &n);
+		for (j = 0; j < n; j++) {
+			if (!elem_nulls[j])
+				sizes[j] += pgq_stat_datum_size(elems[j]);
+		}
+	}
+
+	*total = 0;
+	*max_size = 0;
+	for (j = 0; j < count; j++) {
+		*total += sizes[j];
+		if (sizes[j] > *max_size)
+			*max_size = sizes[j];
+	}
+}
+
+/*
+ * Arguments:
+ * 0: queue_name  text		NOT NULL
+ * 1: ev_type     text[]
+ * 2: ev_data     text[]
+ * 3: ev_extra1   text[]
+ * 4: ev_extra2   text[]
+ * 5: ev_extra3   text[]
+ * 6: ev_extra4   text[]
+ *
+ * All non-NULL arrays must have same length, n-th elements
+ * of arrays make up n-th event.
+ */
+Datum pgq_insert_event_batch_raw(PG_FUNCTION_ARGS)
+{
+	Datum values[8];
+	char nulls[8];
+	struct QueueState state;
+	struct InsertCacheEntry *entry;
+	void *ins_plan;
+	Datum *ids;
+	int i, res, len, count = -1;
+	Datum qname;
+	bool do_stats;
+	instr_time start;
+
+	if (PG_NARGS() < 3)
+		elog(ERROR, "Need at least 3 arguments");
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "Queue name must not be NULL");
+	qname = PG_GETARG_DATUM(0);
+
+	do_stats = pgq_stat_enabled();
+	if (do_stats)
+		INSTR_TIME_SET_CURRENT(start);
+
+	/*
+	 * Find batch size.
+	 */
+	for (i = 1; i < 7; i++) {
+		len = batch_array_length(fcinfo, i);
+		if (len < 0)
+			continue;
+		if (count >= 0 && len != count)
+			elog(ERROR, "Batch arrays must be same length");
+		count = len;
+	}
+	if (count <= 0)
+		PG_RETURN_INT32(0);
+
+	if (SPI_connect() < 0)
+		elog(ERROR, "SPI_connect() failed");
+
+	init_cache();
+
+	load_queue_info(qname, &state);
+
+	check_insert_allowed(&state);
+
+	/*
+	 * With event_id_block >= count, ids come from one block.
+	 */
+	ids = palloc(count * sizeof(Datum));
+	reserve_event_ids(state.event_seq, ids, count);
+
+	/*
+	 * Prepare arguments for INSERT
+	 */
+	values[0] = PointerGetDatum(construct_array(ids, count, INT8OID,
+						    sizeof(int64), FLOAT8PASSBYVAL, 'd'));
+	nulls[0] = ' ';
+	values[1] = DirectFunctionCall1(now, 0);
+	nulls[1] = ' ';
+	for (i = 1; i < 7; i++) {
+		int dst = i + 1;
+		if (i >= PG_NARGS() || PG_ARGISNULL(i)) {
+			values[dst] = (Datum)NULL;
+			nulls[dst] = 'n';
+		} else {
+			values[dst] = PG_GETARG_DATUM(i);
+			nulls[dst] = ' ';
+		}
+	}
+
+	/*
+	 * Perform INSERT into queue table.
+	 */
+	entry = load_insert_cache(qname, &state, count);
+	ins_plan = load_batch_plan(entry, &state);
+	res = SPI_execute_plan(ins_plan, values, nulls, false, 0);
+	if (res != SPI_OK_INSERT)
+		elog(ERROR, "Queue insert failed");
+
+	if (do_stats) {
+		int64 total, max_size;
+		batch_stat_sizes(fcinfo, count, &total, &max_size);
+		pgq_stat_insert(state.queue_id, count, total, max_size, &start);
+	}
+
+	if (SPI_finish() < 0)
+		elog(ERROR, "SPI_finish failed");
+
+	PG_RETURN_INT32(count);
+}
+
+/*
+ * Trigger on pgq.queue that makes backends drop
+ * their cached queue info on any change.
+ */
+Datum pgq_queue_cache_invalidate(PG_FUNCTION_ARGS)
+{
+	TriggerData *tg;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "pgq.queue_cache_invalidate() must be called as trigger");
+	tg = (TriggerData *)fcinfo->context;
+
+	CacheInvalidateRelcacheByRelid(RelationGetRelid(tg->tg_relation));
+
+	PG_RETURN_POINTER(NULL);
+}
+
+/*
+ * Module init, sets up shared stats, tick wait and
+ * background ticker when preloaded.
+ */
+void _PG_init(void)
+{
+	pgq_stat_init();
+	pgq_wait_init();
+	pgq_ticker_init();
+}
@@ -26,3 +26,252 @@ CREATE OR REPLACE FUNCTION pgq.insert_event_raw(
     ev_extra1 text, ev_extra2 text, ev_extra3 text, ev_extra4 text)
 RETURNS int8 AS '$libdir/pgq_lowlevel', 'pgq_insert_event_raw' LANGUAGE C;
 
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.insert_event_batch_raw(7)
+--
+--      Insert several events with one call.  Used by pgq.insert_event_batch().
+--
+-- Parameters:
+--      queue_name      - Name of the queue
+--      ev_type         - user data, array
+--      ev_data         - user data, array
+--      ev_extra1       - user data, array
+--      ev_extra2       - user data, array
+--      ev_extra3       - user data, array
+--      ev_extra4       - user data, array
+--
+--      All non-NULL arrays must be same length, NULL array
+--      means NULL for that field in all events.
+--
+-- Returns:
+--      Number of events inserted.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.insert_event_batch_raw(
+    queue_name text, ev_type text[], ev_data text[],
+    ev_extra1 text[], ev_extra2 text[], ev_extra3 text[], ev_extra4 text[])
+RETURNS int4 AS '$libdir/pgq_lowlevel', 'pgq_insert_event_batch_raw' LANGUAGE C;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.get_batch_events(1)
+--
+--      Get all events in batch.
+--
+--      Snapshot visibility is checked in C and rows are
+--      returned as they are read, without building the
+--      whole result in memory.  Event queries are prepared
+--      once per queue table, batch values are parameters.
+--      Events are in ev_id order, see pgq.get_batch_events(2).
+--
+-- Parameters:
+--      x_batch_id      - ID of active batch.
+--
+-- Returns:
+--      List of events.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.get_batch_events(
+    in x_batch_id   bigint,
+    out ev_id       bigint,
+    out ev_time     timestamptz,
+    out ev_txid     bigint,
+    out ev_retry    int4,
+    out ev_type     text,
+    out ev_data     text,
+    out ev_extra1   text,
+    out ev_extra2   text,
+    out ev_extra3   text,
+    out ev_extra4   text)
+RETURNS SETOF record AS '$libdir/pgq_lowlevel', 'pgq_get_batch_events' LANGUAGE C;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.get_batch_events(2)
+--
+--      Get all events in batch, optionally without ordering.
+--
+--      Ordered events are read from each event table
+--      in ev_id order and merged, so there is no sort
+--      over whole batch.  Without ordering, events come
+--      in whatever order tables are scanned.
+--
+--      Event tables get ev_id index from pgq.create_queue().
+--      Tables of queues created with older version are
+--      sorted separately, until index is added with
+--      CREATE INDEX CONCURRENTLY, see pgq.upgrade_schema().
+--
+-- Parameters:
+--      x_batch_id      - ID of active batch.
+--      x_ordered       - Return events in ev_id order.
+--
+-- Returns:
+--      List of events.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.get_batch_events(
+    in x_batch_id   bigint,
+    in x_ordered    boolean,
+    out ev_id       bigint,
+    out ev_time     timestamptz,
+    out ev_txid     bigint,
+    out ev_retry    int4,
+    out ev_type     text,
+    out ev_data     text,
+    out ev_extra1   text,
+    out ev_extra2   text,
+    out ev_extra3   text,
+    out ev_extra4   text)
+RETURNS SETOF record AS '$libdir/pgq_lowlevel', 'pgq_get_batch_events' LANGUAGE C;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.wait_batch(3)
+--
+--      Same as pgq.next_batch_info(), but if there is no batch
+--      available, waits until queue gets new tick or timeout
+--      is reached.
+--
+--      With pgq_lowlevel in shared_preload_libraries and
+--      PostgreSQL 13+, ticker wakes up waiting consumers
+--      when tick is committed.  Otherwise batch is rechecked
+--      once a second.
+--
+--      Must be called in READ COMMITTED isolation, otherwise
+--      new ticks are not seen during wait, other levels give error.
+--      Call it outside of transaction that has written anything:
+--      assigned txid stays open during wait and holds back
+--      snapshots of new ticks, so batches cannot move past it.
+--
+-- Parameters:
+--      i_queue_name        - Name of the queue
+--      i_consumer_name     - Name of the consumer
+--      i_timeout           - How long to wait for batch
+--
+-- Returns:
+--      Same as pgq.next_batch_info(), batch_id is NULL on timeout.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.wait_batch(
+    in i_queue_name text,
+    in i_consumer_name text,
+    in i_timeout interval,
+    out batch_id int8,
+    out cur_tick_id int8,
+    out prev_tick_id int8,
+    out cur_tick_time timestamptz,
+    out prev_tick_time timestamptz,
+    out cur_tick_event_seq int8,
+    out prev_tick_event_seq int8)
+AS '$libdir/pgq_lowlevel', 'pgq_wait_batch' LANGUAGE C;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.ticker(0)
+--
+--      Creates ticks for all unpaused queues which dont have external ticker.
+--
+--      Same checks as pgq.ticker(1), but state of all queues is
+--      loaded with one query and due ticks are inserted with
+--      one statement, so cost does not grow with per-queue calls.
+--
+--      Called by pgqd, or by background worker in pgq_lowlevel when
+--      it is in shared_preload_libraries and database is listed
+--      in pgq.ticker_databases setting.
+--
+-- Returns:
+--      Number of queues that were processed.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.ticker()
+RETURNS bigint AS '$libdir/pgq_lowlevel', 'pgq_ticker_all' LANGUAGE C SECURITY DEFINER;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.txid_in_batch(3)
+--
+--      Check if transaction committed between two ticks.  Same as
+--
+-- >   txid_visible_in_snapshot(txid, cur_snapshot)
+-- >   and not txid_visible_in_snapshot(txid, last_snapshot)
+--
+--      but snapshots are decoded once per query, into bitmap
+--      for txids that started between ticks, so per-row check
+--      is cheap.  Used by queries from pgq.batch_event_sql().
+--
+-- Parameters:
+--      txid            - Transaction ID from event
+--      last_snapshot   - Snapshot of previous tick
+--      cur_snapshot    - Snapshot of current tick
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.txid_in_batch(
+    txid bigint, last_snapshot txid_snapshot, cur_snapshot txid_snapshot)
+RETURNS boolean AS '$libdir/pgq_lowlevel', 'pgq_txid_in_batch' LANGUAGE C IMMUTABLE STRICT;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.queue_cache_invalidate()
+--
+--      Trigger function on pgq.queue.  Backends cache queue info
+--      for event insertion, this makes them drop it when
+--      pgq.queue is changed.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.queue_cache_invalidate()
+RETURNS trigger AS '$libdir/pgq_lowlevel', 'pgq_queue_cache_invalidate' LANGUAGE C;
+
+DROP TRIGGER IF EXISTS queue_cache_inval ON pgq.queue;
+CREATE TRIGGER queue_cache_inval
+    AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON pgq.queue
+    FOR EACH STATEMENT EXECUTE PROCEDURE pgq.queue_cache_invalidate();
+-- must fire also in 'replica' sessions
+ALTER TABLE pgq.queue ENABLE ALWAYS TRIGGER queue_cache_inval;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.tick_notify()
+--
+--      Trigger function on pgq.tick.  Wakes up pgq.wait_batch()
+--      callers on the queue when transaction commits.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.tick_notify()
+RETURNS trigger AS '$libdir/pgq_lowlevel', 'pgq_tick_notify' LANGUAGE C;
+
+DROP TRIGGER IF EXISTS tick_notify ON pgq.tick;
+CREATE TRIGGER tick_notify
+    AFTER INSERT ON pgq.tick
+    FOR EACH ROW EXECUTE PROCEDURE pgq.tick_notify();
+-- must fire also in 'replica' sessions
+ALTER TABLE pgq.tick ENABLE ALWAYS TRIGGER tick_notify;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.stat_queues_raw(0)
+--
+--      Insert statistics for queues in current database,
+--      kept in shared memory.  Returns empty set unless
+--      pgq_lowlevel is in shared_preload_libraries.
+--
+-- Returns:
+--      queue_id            - Queue ID
+--      events              - Number of events inserted
+--      bytes               - Size of user data in inserted events
+--      max_event_size      - Largest event seen
+--      tx_limit_rejects    - Inserts rejected by queue_per_tx_limit
+--      disabled_rejects    - Inserts rejected by queue_disable_insert
+--      insert_latency_hist - Insert call count by duration, buckets
+--                            end at 10, 50, 100, 500, 1000, 5000, 10000
+--                            microseconds, last one is unbounded.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.stat_queues_raw(
+    OUT queue_id integer, OUT events bigint, OUT bytes bigint,
+    OUT max_event_size bigint, OUT tx_limit_rejects bigint,
+    OUT disabled_rejects bigint, OUT insert_latency_hist bigint[])
+RETURNS SETOF record AS '$libdir/pgq_lowlevel', 'pgq_stat_queues_raw' LANGUAGE C;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.stat_queues_reset(0)
+--
+--      Zero insert statistics for queues in current database.
+--
+--      Also frees entries of dropped queues and databases.  Queues
+--      over pgq.stat_max_queues are not tracked until then.
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.stat_queues_reset()
+RETURNS void AS '$libdir/pgq_lowlevel', 'pgq_stat_queues_reset' LANGUAGE C;
@@ -0,0 +1,535 @@
+/*
+ * stats.c - shared memory statistics for event insertion.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
+
+#include "stats.h"
+
+/*
+ * Stats need atomics and named LWLock tranches.
+ */
+#if PG_VERSION_NUM >= 100000
+#define PGQ_STATS
+#include "port/atomics.h"
+#endif
+
+Datum pgq_stat_queues_raw(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_stat_queues_raw);
+
+Datum pgq_stat_queues_reset(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_stat_queues_reset);
+
+#define STAT_COLS 7
+
+#ifdef PGQ_STATS
+
+/*
+ * Shared hash entry, one per queue.
+ */
+struct PgqStatKey {
+	Oid dbid;
+	int32 queue_id;
+};
+
+struct PgqStatEntry {
+	struct PgqStatKey key;
+	pg_atomic_uint64 events;
+	pg_atomic_uint64 bytes;
+	pg_atomic_uint64 max_event_size;
+	pg_atomic_uint64 tx_limit_rejects;
+	pg_atomic_uint64 disabled_rejects;
+	pg_atomic_uint64 latency[PGQ_STAT_LATENCY_BUCKETS];
+};
+
+struct PgqStatShared {
+	LWLock *lock;
+	/* bumped when entries are removed */
+	pg_atomic_uint32 generation;
+};
+
+/*
+ * Backend-local map from queue_id to shared entry.
+ * Entries are removed only by pgq.stat_queues_reset(), which
+ * bumps generation, then map is rebuilt.
+ */
+struct PgqStatLocal {
+	int32 queue_id;
+	struct PgqStatEntry *entry;
+};
+
+static const int64 latency_bounds[] = PGQ_STAT_LATENCY_BOUNDS;
+
+static int stat_max_queues = 1000;
+
+static struct PgqStatShared *stat_shared;
+static HTAB *stat_hash;
+static HTAB *stat_local;
+static uint32 stat_local_generation;
+
+/* shared hash was full at this generation */
+static bool stat_full;
+static uint32 stat_full_generation;
+static bool stat_full_warned;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook;
+
+static Size stat_shmem_size(void)
+{
+	return add_size(MAXALIGN(sizeof(struct PgqStatShared)),
+			hash_estimate_size(stat_max_queues, sizeof(struct PgqStatEntry)));
+}
+
+static void stat_request_shmem(void)
+{
+	RequestAddinShmemSpace(stat_shmem_size());
+	RequestNamedLWLockTranche("pgq_lowlevel", 1);
+}
+
+#if PG_VERSION_NUM >= 150000
+static void stat_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+	stat_request_shmem();
+}
+#endif
+
+static void stat_shmem_startup(void)
+{
+	HASHCTL ctl;
+	bool found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	stat_shared = ShmemInitStruct("pgq_lowlevel stats", sizeof(struct PgqStatShared), &found);
+	if (!found) {
+		stat_shared->lock = &(GetNamedLWLockTranche("pgq_lowlevel"))->lock;
+		pg_atomic_init_u32(&stat_shared->generation, 0);
+	}
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(struct PgqStatKey);
+	ctl.entrysize = sizeof(struct PgqStatEntry);
+	stat_hash = ShmemInitHash("pgq_lowlevel stats hash", stat_max_queues, stat_max_queues,
+				  &ctl, HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Find or create shared entry for queue.
+ *
+ * Returns NULL if stats are full, that is not cached,
+ * so queue gets entry when space is freed.
+ */
+static struct PgqStatEntry *find_entry(int queue_id)
+{
+	struct PgqStatLocal *local;
+	struct PgqStatEntry *entry;
+	struct PgqStatKey key;
+	HASHCTL ctl;
+	bool found;
+	uint32 generation;
+	int i;
+
+	generation = pg_atomic_read_u32(&stat_shared->generation);
+	if (stat_local && generation != stat_local_generation) {
+		hash_destroy(stat_local);
+		stat_local = NULL;
+	}
+	if (!stat_local) {
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(int32);
+		ctl.entrysize = sizeof(struct PgqStatLocal);
+		stat_local = hash_create("pgq_lowlevel stats map", 128, &ctl, HASH_ELEM | HASH_BLOBS);
+		stat_local_generation = generation;
+	}
+
+	MemSet(&key, 0, sizeof(key));
+	key.dbid = MyDatabaseId;
+	key.queue_id = queue_id;
+
+	/* removed entry may be reused before generation is seen */
+	local = hash_search(stat_local, &queue_id, HASH_FIND, NULL);
+	if (local && memcmp(&local->entry->key, &key, sizeof(key)) == 0)
+		return local->entry;
+
+	LWLockAcquire(stat_shared->lock, LW_SHARED);
+	entry = hash_search(stat_hash, &key, HASH_FIND, NULL);
+	LWLockRelease(stat_shared->lock);
+
+	/* no point retrying until something is removed */
+	if (!entry && stat_full && stat_full_generation == generation)
+		return NULL;
+
+	if (!entry) {
+		LWLockAcquire(stat_shared->lock, LW_EXCLUSIVE);
+		entry = hash_search(stat_hash, &key, HASH_ENTER_NULL, &found);
+		if (entry && !found) {
+			pg_atomic_init_u64(&entry->events, 0);
+			pg_atomic_init_u64(&entry->bytes, 0);
+			pg_atomic_init_u64(&entry->max_event_size, 0);
+			pg_atomic_init_u64(&entry->tx_limit_rejects, 0);
+			pg_atomic_init_u64(&entry->disabled_rejects, 0);
+			for (i = 0; i < PGQ_STAT_LATENCY_BUCKETS; i++)
+				pg_atomic_init_u64(&entry->latency[i], 0);
+		}
+		LWLockRelease(stat_shared->lock);
+	}
+
+	if (!entry) {
+		stat_full = true;
+		stat_full_generation = generation;
+		if (!stat_full_warned) {
+			elog(WARNING, "pgq.stat_max_queues (%d) reached, queue %d is not tracked",
+			     stat_max_queues, queue_id);
+			stat_full_warned = true;
+		}
+		return NULL;
+	}
+
+	local = hash_search(stat_local, &queue_id, HASH_ENTER, NULL);
+	local->entry = entry;
+	return entry;
+}
+
+static int cmp_int32(const void *a, const void *b)
+{
+	int32 x = *(const int32 *)a;
+	int32 y = *(const int32 *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Free entries of dropped queues in current database
+ * and of dropped databases.
+ */
+static void remove_stale_entries(void)
+{
+	HASH_SEQ_STATUS seq;
+	struct PgqStatEntry *entry;
+	int32 *queue_ids;
+	Oid *dbids;
+	int nqueues, ndbs = 0, max_dbs = 16;
+	bool removed = false, isnull;
+	uint64 i;
+	int j;
+
+	if (SPI_connect() < 0)
+		elog(ERROR, "SPI_connect() failed");
+	if (SPI_execute("select queue_id from pgq.queue", true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "pgq.stat_queues_reset: queue query failed");
+	nqueues = SPI_processed;
+	queue_ids = palloc((nqueues + 1) * sizeof(int32));
+	for (i = 0; i < SPI_processed; i++)
+		queue_ids[i] = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[i],
+							   SPI_tuptable->tupdesc, 1, &isnull));
+	if (SPI_finish() < 0)
+		elog(ERROR, "SPI_finish() failed");
+	qsort(queue_ids, nqueues, sizeof(int32), cmp_int32);
+
+	/* find dropped databases, without holding lock during catalog lookups */
+	dbids = palloc(max_dbs * sizeof(Oid));
+	LWLockAcquire(stat_shared->lock, LW_SHARED);
+	hash_seq_init(&seq, stat_hash);
+	while ((entry = hash_seq_search(&seq)) != NULL) {
+		if (entry->key.dbid == MyDatabaseId)
+			continue;
+		for (j = 0; j < ndbs; j++) {
+			if (dbids[j] == entry->key.dbid)
+				break;
+		}
+		if (j < ndbs)
+			continue;
+		if (ndbs == max_dbs) {
+			max_dbs *= 2;
+			dbids = repalloc(dbids, max_dbs * sizeof(Oid));
+		}
+		dbids[ndbs++] = entry->key.dbid;
+	}
+	LWLockRelease(stat_shared->lock);
+
+	for (j = 0; j < ndbs; ) {
+		if (SearchSysCacheExists1(DATABASEOID, ObjectIdGetDatum(dbids[j])))
+			dbids[j] = dbids[--ndbs];
+		else
+			j++;
+	}
+
+	LWLockAcquire(stat_shared->lock, LW_EXCLUSIVE);
+	hash_seq_init(&seq, stat_hash);
+	while ((entry = hash_seq_search(&seq)) != NULL) {
+		bool stale = false;
+
+		if (entry->key.dbid == MyDatabaseId) {
+			stale = !bsearch(&entry->key.queue_id, queue_ids, nqueues,
+					 sizeof(int32), cmp_int32);
+		} else {
+			for (j = 0; j < ndbs; j++) {
+				if (dbids[j] == entry->key.dbid)
+					stale = true;
+			}
+		}
+		if (stale) {
+			hash_search(stat_hash, &entry->key, HASH_REMOVE, NULL);
+			removed = true;
+		}
+	}
+	if (removed)
+		pg_atomic_fetch_add_u32(&stat_shared->generation, 1);
+	LWLockRelease(stat_shared->lock);
+}
+
+/*
+ * Register shared memory, works only from shared_preload_libraries.
+ */
+void pgq_stat_init(void)
+{
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomIntVariable("pgq.stat_max_queues",
+				"Max number of queues tracked in pgq.stat_queues.",
+				NULL,
+				&stat_max_queues,
+				1000, 10, 1000000,
+				PGC_POSTMASTER,
+				0,
+				NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = stat_shmem_request;
+#else
+	stat_request_shmem();
+#endif
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = stat_shmem_startup;
+}
+
+bool pgq_stat_enabled(void)
+{
+	return stat_hash != NULL;
+}
+
+/*
+ * Count inserted events.
+ */
+void pgq_stat_insert(int queue_id, int64 events, int64 bytes, int64 max_size, instr_time *start)
+{
+	struct PgqStatEntry *entry;
+	instr_time now;
+	uint64 cur, usec;
+	int i;
+
+	if (!stat_hash)
+		return;
+	entry = find_entry(queue_id);
+	if (!entry)
+		return;
+
+	pg_atomic_fetch_add_u64(&entry->events, events);
+	pg_atomic_fetch_add_u64(&entry->bytes, bytes);
+
+	cur = pg_atomic_read_u64(&entry->max_event_size);
+	while (max_size > cur) {
+		if (pg_atomic_compare_exchange_u64(&entry->max_event_size, &cur, max_size))
+			break;
+	}
+
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, *start);
+	usec = INSTR_TIME_GET_MICROSEC(now);
+	for (i = 0; i < PGQ_STAT_LATENCY_BUCKETS - 1; i++) {
+		if (usec < latency_bounds[i])
+			break;
+	}
+	pg_atomic_fetch_add_u64(&entry->latency[i], 1);
+}
+
+/*
+ * Count rejected insert.
+ */
+void pgq_stat_reject(int queue_id, enum PgqStatReject reason)
+{
+	struct PgqStatEntry *entry;
+
+	if (!stat_hash)
+		return;
+	entry = find_entry(queue_id);
+	if (!entry)
+		return;
+
+	if (reason == PGQ_STAT_REJECT_TX_LIMIT)
+		pg_atomic_fetch_add_u64(&entry->tx_limit_rejects, 1);
+	else
+		pg_atomic_fetch_add_u64(&entry->disabled_rejects, 1);
+}
+
+#else /* !PGQ_STATS */
+
+void pgq_stat_init(void)
+{
+}
+
+bool pgq_stat_enabled(void)
+{
+	return false;
+}
+
+void pgq_stat_insert(int queue_id, int64 events, int64 bytes, int64 max_size, instr_time *start)
+{
+}
+
+void pgq_stat_reject(int queue_id, enum PgqStatReject reason)
+{
+}
+
+#endif
+
+/*
+ * Size of event field.
+ */
+int64 pgq_stat_datum_size(Datum value)
+{
+	return toast_raw_datum_size(value) - VARHDRSZ;
+}
+
+/*
+ * Return stats for queues in current database.
+ *
+ * Returns empty set if pgq_lowlevel is not in shared_preload_libraries.
+ */
+Datum pgq_stat_queues_raw(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+	MemoryContext old_ctx;
+#ifdef PGQ_STATS
+	HASH_SEQ_STATUS seq;
+	struct PgqStatEntry *entry;
+	Datum values[STAT_COLS];
+	bool nulls[STAT_COLS];
+	Datum hist[PGQ_STAT_LATENCY_BUCKETS];
+	int i;
+#endif
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		elog(ERROR, "set-valued function called in context that cannot accept a set");
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		elog(ERROR, "materialize mode required, but it is not allowed in this context");
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	old_ctx = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(old_ctx);
+
+#ifdef PGQ_STATS
+	if (!stat_hash)
+		return (Datum) 0;
+
+	MemSet(nulls, 0, sizeof(nulls));
+
+	LWLockAcquire(stat_shared->lock, LW_SHARED);
+	hash_seq_init(&seq, stat_hash);
+	while ((entry = hash_seq_search(&seq)) != NULL) {
+		if (entry->key.dbid != MyDatabaseId)
+			continue;
+
+		for (i = 0; i < PGQ_STAT_LATENCY_BUCKETS; i++)
+			hist[i] = Int64GetDatum(pg_atomic_read_u64(&entry->latency[i]));
+
+		values[0] = Int32GetDatum(entry->key.queue_id);
+		values[1] = Int64GetDatum(pg_atomic_read_u64(&entry->events));
+		values[2] = Int64GetDatum(pg_atomic_read_u64(&entry->bytes));
+		values[3] = Int64GetDatum(pg_atomic_read_u64(&entry->max_event_size));
+		values[4] = Int64GetDatum(pg_atomic_read_u64(&entry->tx_limit_rejects));
+		values[5] = Int64GetDatum(pg_atomic_read_u64(&entry->disabled_rejects));
+		values[6] = PointerGetDatum(construct_array(hist, PGQ_STAT_LATENCY_BUCKETS, INT8OID,
+							    sizeof(int64), FLOAT8PASSBYVAL, 'd'));
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	LWLockRelease(stat_shared->lock);
+#endif
+
+	return (Datum) 0;
+}
+
+/*
+ * Zero stats for queues in current database,
+ * free entries of dropped queues and databases.
+ */
+Datum pgq_stat_queues_reset(PG_FUNCTION_ARGS)
+{
+#ifdef PGQ_STATS
+	HASH_SEQ_STATUS seq;
+	struct PgqStatEntry *entry;
+	int i;
+
+	if (!stat_hash)
+		PG_RETURN_VOID();
+
+	remove_stale_entries();
+
+	LWLockAcquire(stat_shared->lock, LW_SHARED);
+	hash_seq_init(&seq, stat_hash);
+	while ((entry = hash_seq_search(&seq)) != NULL) {
+		if (entry->key.dbid != MyDatabaseId)
+			continue;
+		pg_atomic_write_u64(&entry->events, 0);
+		pg_atomic_write_u64(&entry->bytes, 0);
+		pg_atomic_write_u64(&entry->max_event_size, 0);
+		pg_atomic_write_u64(&entry->tx_limit_rejects, 0);
+		pg_atomic_write_u64(&entry->disabled_rejects, 0);
+		for (i = 0; i < PGQ_STAT_LATENCY_BUCKETS; i++)
+			pg_atomic_write_u64(&entry->latency[i], 0);
+	}
+	LWLockRelease(stat_shared->lock);
+#endif
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,16 @@
+#include <portability/instr_time.h>
+
+/* upper bounds of latency histogram buckets, in microseconds */
+#define PGQ_STAT_LATENCY_BOUNDS { 10, 50, 100, 500, 1000, 5000, 10000 }
+#define PGQ_STAT_LATENCY_BUCKETS 8
+
+enum PgqStatReject {
+	PGQ_STAT_REJECT_DISABLED,
+	PGQ_STAT_REJECT_TX_LIMIT,
+};
+
+void pgq_stat_init(void);
+bool pgq_stat_enabled(void);
+int64 pgq_stat_datum_size(Datum value);
+void pgq_stat_insert(int queue_id, int64 events, int64 bytes, int64 max_size, instr_time *start);
+void pgq_stat_reject(int queue_id, enum PgqStatReject reason);
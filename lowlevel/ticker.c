@@ -0,0 +1,650 @@
+/*
+ * ticker.c - set-based pgq.ticker() and background worker
+ * for ticks and maintenance.
+ *
+ * Does same work as pgqd, but inside server.  Runs when
+ * pgq_lowlevel is in shared_preload_libraries and database
+ * is listed in pgq.ticker_databases.
+ *
+ * Settings:
+ *	pgq.ticker_databases	- comma-separated list of databases, empty disables
+ *	pgq.ticker_period	- max sleep in msec while queues have untick events
+ *	pgq.maint_period	- seconds between maintenance runs
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/varlena.h"
+
+#include "ticker.h"
+
+#ifndef INT4ARRAYOID
+#define INT4ARRAYOID 1007
+#endif
+#ifndef INT8ARRAYOID
+#define INT8ARRAYOID 1016
+#endif
+#ifndef FLOAT8ARRAYOID
+#define FLOAT8ARRAYOID 1022
+#endif
+
+PGDLLEXPORT void pgq_ticker_main(Datum arg);
+
+Datum pgq_ticker_all(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_ticker_all);
+
+/*
+ * Tick state for all queues, with same conditions as pgq.ticker(1).
+ * Latest tick is fetched once per queue, previous one is
+ * needed only for idle period, subscriptions only for
+ * adaptive ticking.  Sequence moves by event id block
+ * per call, so it is divided out of event counts.
+ */
+#define TICK_STATE_SQL \
+	"select q.queue_id, q.event_seq, t.tick_id is null," \
+	"       q.event_seq - t.tick_event_seq," \
+	"       now() - t.tick_time >= q.queue_ticker_max_lag" \
+	"           or (q.event_seq - t.tick_event_seq) / q.queue_event_id_block >= q.queue_ticker_max_count," \
+	"       now() - t.tick_time >= q.queue_ticker_max_lag" \
+	"           or q.queue_ticker_max_count <= 1," \
+	"       p.tick_time is null" \
+	"           or (now() - t.tick_time >= q.queue_ticker_max_lag / 2" \
+	"               and (now() - t.tick_time >= (t.tick_time - p.tick_time) * 2" \
+	"                    or now() - t.tick_time >= q.queue_ticker_idle_period))," \
+	"       txid_snapshot_xmin(t.tick_snapshot), txid_snapshot_xmax(t.tick_snapshot)," \
+	"       t.tick_snapshot::text," \
+	"       case when q.queue_event_id_block > 1" \
+	"            then pgq.quote_fqname(q.queue_data_pfx || '_' || q.queue_cur_table::text) end," \
+	"       case when q.queue_event_id_block > 1" \
+	"                 and (q.queue_switch_step2 is null" \
+	"                      or txid_snapshot_xmin(t.tick_snapshot) <= q.queue_switch_step2)" \
+	"            then pgq.quote_fqname(q.queue_data_pfx || '_'" \
+	"                                  || ((q.queue_cur_table + q.queue_ntables - 1) % q.queue_ntables)::text) end," \
+	"       txid_current()," \
+	"       case when q.queue_ticker_target_count > 0 then" \
+	"           now() - t.tick_time >= (select coalesce(max(s.sub_batch_time), '0')" \
+	"                                     from pgq.subscription s where s.sub_queue = q.queue_id)" \
+	"           and greatest((q.event_seq - t.tick_event_seq) / q.queue_event_id_block, 1)" \
+	"                   >= q.queue_ticker_target_count end," \
+	"       coalesce(t.tick_event_rate * 0.75 + t.sample_rate * 0.25," \
+	"                t.sample_rate, t.tick_event_rate)" \
+	"  from (select queue_id, queue_ticker_max_count, queue_ticker_max_lag," \
+	"               queue_ticker_idle_period, queue_ticker_target_count, queue_event_id_block," \
+	"               queue_data_pfx, queue_cur_table, queue_ntables, queue_switch_step2," \
+	"               pgq.seq_getval(queue_event_seq) as event_seq" \
+	"          from pgq.queue" \
+	"         where not queue_external_ticker and not queue_ticker_paused) q" \
+	"  left join lateral (select tick_id, tick_time, tick_event_seq, tick_snapshot, tick_event_rate," \
+	"                            greatest(q.event_seq - tick_event_seq, 0) / q.queue_event_id_block" \
+	"                              / nullif(extract(epoch from now() - tick_time)::float8, 0) as sample_rate" \
+	"                       from pgq.tick where tick_queue = q.queue_id" \
+	"                      order by tick_queue desc, tick_id desc limit 1) t on true" \
+	"  left join lateral (select tick_time from pgq.tick" \
+	"                      where tick_queue = q.queue_id and tick_id < t.tick_id" \
+	"                      order by tick_queue desc, tick_id desc limit 1) p on true"
+
+enum TickStateCol {
+	COL_QUEUE_ID = 1,
+	COL_EVENT_SEQ,
+	COL_NO_TICK,
+	COL_NEW_EVENTS,
+	COL_BUSY_DUE,
+	COL_BLOCK_DUE,
+	COL_IDLE_DUE,
+	COL_XMIN,
+	COL_XMAX,
+	COL_SNAPSHOT,
+	COL_CUR_TABLE,
+	COL_PREV_TABLE,
+	COL_TXID,
+	COL_ADAPT_DUE,
+	COL_NEW_RATE,
+};
+
+#define TICK_INSERT_SQL \
+	"insert into pgq.tick (tick_queue, tick_id, tick_event_seq, tick_event_rate)" \
+	" select q.queue_id, nextval(q.queue_tick_seq), x.event_seq, x.event_rate" \
+	"   from unnest($1::int4[], $2::int8[], $3::float8[]) x (queue_id, event_seq, event_rate)," \
+	"        pgq.queue q" \
+	"  where q.queue_id = x.queue_id"
+
+/* sleep at least this long when ticker has nothing to do */
+#define TICKER_MIN_SLEEP_MSEC	10
+
+#define PGQ_CHECK_SQL \
+	"select count(*) from pg_catalog.pg_proc p, pg_catalog.pg_namespace n" \
+	" where n.oid = p.pronamespace and n.nspname = 'pgq' and p.proname = 'maint_operations'"
+
+#define TICKER_SQL	"select pgq.ticker()"
+
+#define MAINT_SQL	"select func_name, func_arg from pgq.maint_operations()"
+
+/*
+ * When next tick may be needed.  Same conditions as in pgq.ticker(1):
+ * with new events at max_lag, without them when idle period logic
+ * allows.  With ticker_target_count, average event rate predicts when
+ * target is reached, until that moment has passed.  ticker_max_count
+ * cannot be predicted, so queues that have new events are also
+ * checked every pgq.ticker_period.
+ */
+#define NEXT_TICK_SQL \
+	"select (extract(epoch from min(case when t.new_events" \
+	"                                    then least(t.tick_time + t.queue_ticker_max_lag," \
+	"                                               case when t.adapt_time > now() then t.adapt_time end)" \
+	"                                    else t.tick_time + greatest(t.queue_ticker_max_lag / 2," \
+	"                                             least(coalesce(t.prev_lag * 2, '0'), t.queue_ticker_idle_period))" \
+	"                               end - now())) * 1000)::int8," \
+	"       coalesce(bool_or(t.new_events), false)" \
+	"  from (select q.queue_ticker_max_lag, q.queue_ticker_idle_period, last.tick_time," \
+	"               pgq.seq_getval(q.queue_event_seq) > last.tick_event_seq" \
+	"                   or q.queue_event_id_block > 1 as new_events," \
+	"               last.tick_time - (select p.tick_time from pgq.tick p" \
+	"                                  where p.tick_queue = q.queue_id and p.tick_id < last.tick_id" \
+	"                                  order by p.tick_queue desc, p.tick_id desc limit 1) as prev_lag," \
+	"               case when q.queue_ticker_target_count > 0 and last.tick_event_rate > 0" \
+	"                    then last.tick_time" \
+	"                         + greatest(interval '1 second' * (q.queue_ticker_target_count / last.tick_event_rate)," \
+	"                                    (select coalesce(max(s.sub_batch_time), '0') from pgq.subscription s" \
+	"                                      where s.sub_queue = q.queue_id))" \
+	"               end as adapt_time" \
+	"          from pgq.queue q," \
+	"               lateral (select tick_id, tick_time, tick_event_seq, tick_event_rate from pgq.tick" \
+	"                         where tick_queue = q.queue_id" \
+	"                         order by tick_queue desc, tick_id desc limit 1) last" \
+	"         where not q.queue_external_ticker and not q.queue_ticker_paused) t"
+
+static char *ticker_databases = NULL;
+static int ticker_period = 1000;
+static int maint_period = 120;
+
+static volatile sig_atomic_t got_sighup = false;
+static volatile sig_atomic_t got_sigterm = false;
+
+/*
+ * Result of single query.
+ */
+struct TickerQuery {
+	const char *sql;
+	bool read_only;
+
+	/* first two columns of first row, as int8/bool */
+	int64 value;
+	bool value_null;
+	bool flag;
+
+	/* with rows_ctx, first two columns of all rows as char *[2] */
+	MemoryContext rows_ctx;
+	List *rows;
+};
+
+static int64 get_int8(HeapTuple row, TupleDesc desc, int col, bool *isnull)
+{
+	Datum val = SPI_getbinval(row, desc, col, isnull);
+	return *isnull ? 0 : DatumGetInt64(val);
+}
+
+static bool get_bool(HeapTuple row, TupleDesc desc, int col)
+{
+	bool isnull;
+	Datum val = SPI_getbinval(row, desc, col, &isnull);
+	return !isnull && DatumGetBool(val);
+}
+
+/*
+ * With event id blocks, inserts use ids reserved earlier
+ * and sequence does not move, so look into tables that
+ * next batch reads: current one and previous one until
+ * rotation is behind last tick.
+ */
+static bool block_has_events(const char *cur_table, const char *prev_table,
+			     int64 sxmin, const char *snapshot)
+{
+	StringInfoData sql;
+	int res;
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "select true from %s where ev_txid >= " INT64_FORMAT
+			 "   and not txid_visible_in_snapshot(ev_txid, %s)",
+			 cur_table, sxmin, quote_literal_cstr(snapshot));
+	if (prev_table)
+		appendStringInfo(&sql, " union all select true from %s where ev_txid >= " INT64_FORMAT
+				 "   and not txid_visible_in_snapshot(ev_txid, %s)",
+				 prev_table, sxmin, quote_literal_cstr(snapshot));
+	appendStringInfoString(&sql, " limit 1");
+	res = SPI_execute(sql.data, true, 1);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "pgq.ticker: event check failed: %d", res);
+	pfree(sql.data);
+	return SPI_processed > 0;
+}
+
+/*
+ * Check all queues with one query and insert due ticks with one insert.
+ */
+Datum pgq_ticker_all(PG_FUNCTION_ARGS)
+{
+	SPITupleTable *state;
+	TupleDesc desc;
+	HeapTuple row;
+	uint64 nqueues, i;
+	Datum *ids, *seqs, *rates;
+	bool *rate_nulls;
+	int ndue = 0;
+	int dims[1], lbs[1] = { 1 };
+	Oid types[3];
+	Datum args[3];
+	int64 new_events, event_seq, sxmin, sxmax, txid;
+	bool new_null, isnull, has_events, due;
+	char *cur_table;
+	int res;
+
+	if (SPI_connect() < 0)
+		elog(ERROR, "SPI_connect() failed");
+
+	res = SPI_execute(TICK_STATE_SQL, false, 0);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "pgq.ticker: state query failed: %d", res);
+
+	/* block checks below replace SPI_tuptable */
+	state = SPI_tuptable;
+	desc = state->tupdesc;
+	nqueues = SPI_processed;
+
+	ids = palloc((nqueues + 1) * sizeof(Datum));
+	seqs = palloc((nqueues + 1) * sizeof(Datum));
+	rates = palloc((nqueues + 1) * sizeof(Datum));
+	rate_nulls = palloc((nqueues + 1) * sizeof(bool));
+
+	for (i = 0; i < nqueues; i++) {
+		row = state->vals[i];
+		event_seq = get_int8(row, desc, COL_EVENT_SEQ, &isnull);
+
+		if (get_bool(row, desc, COL_NO_TICK)) {
+			due = true;
+		} else {
+			new_events = get_int8(row, desc, COL_NEW_EVENTS, &new_null);
+			sxmin = get_int8(row, desc, COL_XMIN, &isnull);
+			sxmax = get_int8(row, desc, COL_XMAX, &isnull);
+			txid = get_int8(row, desc, COL_TXID, &isnull);
+
+			if (sxmin > txid)
+				elog(ERROR, "Invalid PgQ state: old xmin=" INT64_FORMAT ", old xmax=" INT64_FORMAT
+				     ", cur txid=" INT64_FORMAT, sxmin, sxmax, txid);
+			if (!new_null && new_events < 0)
+				elog(WARNING, "Negative new_events?  old=" INT64_FORMAT " cur=" INT64_FORMAT,
+				     event_seq - new_events, event_seq);
+			if (sxmax > txid)
+				elog(WARNING, "Dubious PgQ state: old xmax=" INT64_FORMAT ", cur txid=" INT64_FORMAT,
+				     sxmax, txid);
+
+			if (new_null) {
+				due = get_bool(row, desc, COL_IDLE_DUE);
+			} else if (new_events > 0) {
+				due = get_bool(row, desc, COL_BUSY_DUE) || get_bool(row, desc, COL_ADAPT_DUE);
+			} else {
+				cur_table = SPI_getvalue(row, desc, COL_CUR_TABLE);
+				has_events = cur_table && block_has_events(cur_table,
+									   SPI_getvalue(row, desc, COL_PREV_TABLE), sxmin,
+									   SPI_getvalue(row, desc, COL_SNAPSHOT));
+				if (has_events)
+					due = get_bool(row, desc, COL_BLOCK_DUE) || get_bool(row, desc, COL_ADAPT_DUE);
+				else
+					due = get_bool(row, desc, COL_IDLE_DUE);
+			}
+		}
+
+		if (due) {
+			ids[ndue] = SPI_getbinval(row, desc, COL_QUEUE_ID, &isnull);
+			seqs[ndue] = Int64GetDatum(event_seq);
+			rates[ndue] = SPI_getbinval(row, desc, COL_NEW_RATE, &rate_nulls[ndue]);
+			ndue++;
+		}
+	}
+
+	res = 0;
+	if (ndue > 0) {
+		dims[0] = ndue;
+		types[0] = INT4ARRAYOID;
+		types[1] = INT8ARRAYOID;
+		types[2] = FLOAT8ARRAYOID;
+		args[0] = PointerGetDatum(construct_array(ids, ndue, INT4OID, sizeof(int32), true, 'i'));
+		args[1] = PointerGetDatum(construct_array(seqs, ndue, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, 'd'));
+		args[2] = PointerGetDatum(construct_md_array(rates, rate_nulls, 1, dims, lbs,
+							     FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, 'd'));
+		res = SPI_execute_with_args(TICK_INSERT_SQL, 3, types, args, NULL, false, 0);
+		if (res != SPI_OK_INSERT)
+			elog(ERROR, "pgq.ticker: tick insert failed: %d", res);
+		res = SPI_processed;
+	}
+
+	if (SPI_finish() < 0)
+		elog(ERROR, "SPI_finish() failed");
+
+	PG_RETURN_INT64(res);
+}
+
+static void ticker_sighup(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_sighup = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void ticker_sigterm(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_sigterm = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void fetch_result(struct TickerQuery *q)
+{
+	TupleDesc desc = SPI_tuptable->tupdesc;
+	MemoryContext old_ctx;
+	HeapTuple row;
+	char *val;
+	char **pair;
+	uint64 i;
+
+	q->value_null = true;
+	q->flag = false;
+	if (SPI_processed == 0)
+		return;
+
+	row = SPI_tuptable->vals[0];
+	val = SPI_getvalue(row, desc, 1);
+	if (val) {
+		q->value = strtoll(val, NULL, 10);
+		q->value_null = false;
+	}
+	if (desc->natts > 1) {
+		val = SPI_getvalue(row, desc, 2);
+		q->flag = val && val[0] == 't';
+	}
+
+	if (!q->rows_ctx)
+		return;
+	old_ctx = MemoryContextSwitchTo(q->rows_ctx);
+	for (i = 0; i < SPI_processed; i++) {
+		pair = palloc(2 * sizeof(char *));
+		pair[0] = SPI_getvalue(SPI_tuptable->vals[i], desc, 1);
+		pair[1] = SPI_getvalue(SPI_tuptable->vals[i], desc, 2);
+		q->rows = lappend(q->rows, pair);
+	}
+	MemoryContextSwitchTo(old_ctx);
+}
+
+/*
+ * Run query in its own transaction.  Errors are logged
+ * and worker continues.
+ */
+static bool run_query(struct TickerQuery *q)
+{
+	MemoryContext ctx = CurrentMemoryContext;
+	bool ok = true;
+	int res;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, q->sql);
+
+	PG_TRY();
+	{
+		if (SPI_connect() != SPI_OK_CONNECT)
+			elog(ERROR, "SPI_connect() failed");
+		res = SPI_execute(q->sql, q->read_only, 0);
+		if (res != SPI_OK_SELECT)
+			elog(ERROR, "pgq ticker: query failed: %d: %s", res, q->sql);
+		fetch_result(q);
+		if (SPI_finish() != SPI_OK_FINISH)
+			elog(ERROR, "SPI_finish() failed");
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(ctx);
+		EmitErrorReport();
+		FlushErrorState();
+		AbortCurrentTransaction();
+		ok = false;
+	}
+	PG_END_TRY();
+
+	/* transaction end leaves TopMemoryContext active */
+	MemoryContextSwitchTo(ctx);
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+	return ok;
+}
+
+/*
+ * Run operations from pgq.maint_operations(), each in separate
+ * transaction.  Function is called again while it returns 1.
+ */
+static void run_maint(MemoryContext ctx)
+{
+	struct TickerQuery q;
+	StringInfoData sql;
+	ListCell *lc;
+	char **pair;
+	char *func, *arg;
+
+	MemSet(&q, 0, sizeof(q));
+	q.sql = MAINT_SQL;
+	q.rows_ctx = ctx;
+	if (!run_query(&q))
+		return;
+
+	initStringInfo(&sql);
+	foreach(lc, q.rows) {
+		pair = lfirst(lc);
+		func = pair[0];
+		arg = pair[1];
+
+		/* cannot run inside transaction, leave it to autovacuum */
+		if (!func || strcmp(func, "vacuum") == 0)
+			continue;
+
+		resetStringInfo(&sql);
+		if (arg)
+			appendStringInfo(&sql, "select %s(%s)", func, quote_literal_cstr(arg));
+		else
+			appendStringInfo(&sql, "select %s()", func);
+
+		MemSet(&q, 0, sizeof(q));
+		q.sql = sql.data;
+		do {
+			CHECK_FOR_INTERRUPTS();
+			if (got_sigterm || !run_query(&q))
+				break;
+		} while (!q.value_null && q.value == 1);
+	}
+}
+
+/*
+ * Worker main loop.
+ */
+void pgq_ticker_main(Datum arg)
+{
+	char dbname[BGW_EXTRALEN];
+	struct TickerQuery q;
+	MemoryContext loop_ctx;
+	TimestampTz next_maint = 0;
+	long sleep_ms;
+	int rc;
+
+	memcpy(dbname, MyBgworkerEntry->bgw_extra, BGW_EXTRALEN);
+	dbname[BGW_EXTRALEN - 1] = 0;
+
+	pqsignal(SIGHUP, ticker_sighup);
+	pqsignal(SIGTERM, ticker_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+#if PG_VERSION_NUM >= 110000
+	BackgroundWorkerInitializeConnection(dbname, NULL, 0);
+#else
+	BackgroundWorkerInitializeConnection(dbname, NULL);
+#endif
+	elog(LOG, "pgq ticker started for database %s", dbname);
+
+	loop_ctx = AllocSetContextCreate(TopMemoryContext,
+					 "pgq ticker",
+#if (PG_VERSION_NUM >= 110000)
+					 ALLOCSET_DEFAULT_SIZES
+#else
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE
+#endif
+					 );
+
+	while (!got_sigterm) {
+		MemoryContextReset(loop_ctx);
+		MemoryContextSwitchTo(loop_ctx);
+
+		if (got_sighup) {
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+		sleep_ms = maint_period * 1000L;
+
+		/* nothing to do until pgq is installed */
+		MemSet(&q, 0, sizeof(q));
+		q.sql = PGQ_CHECK_SQL;
+		q.read_only = true;
+		if (!run_query(&q) || q.value <= 0)
+			goto wait;
+
+		MemSet(&q, 0, sizeof(q));
+		q.sql = TICKER_SQL;
+		run_query(&q);
+
+		if (GetCurrentTimestamp() >= next_maint) {
+			run_maint(loop_ctx);
+			next_maint = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+								 maint_period * 1000L);
+		}
+
+		/* sleep until next queue may need tick */
+		MemSet(&q, 0, sizeof(q));
+		q.sql = NEXT_TICK_SQL;
+		q.read_only = true;
+		if (run_query(&q)) {
+			if (q.flag && sleep_ms > ticker_period)
+				sleep_ms = ticker_period;
+			if (!q.value_null && q.value < sleep_ms)
+				sleep_ms = q.value;
+		} else {
+			sleep_ms = ticker_period;
+		}
+		if (sleep_ms < TICKER_MIN_SLEEP_MSEC)
+			sleep_ms = TICKER_MIN_SLEEP_MSEC;
+wait:
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+			       sleep_ms, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	proc_exit(0);
+}
+
+/*
+ * Register settings and workers, works only from shared_preload_libraries.
+ */
+void pgq_ticker_init(void)
+{
+	BackgroundWorker worker;
+	List *dblist = NIL;
+	ListCell *lc;
+	char *dbnames;
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomStringVariable("pgq.ticker_databases",
+				   "Databases where background ticker runs, comma-separated.",
+				   NULL,
+				   &ticker_databases,
+				   "",
+				   PGC_POSTMASTER,
+				   0,
+				   NULL, NULL, NULL);
+	DefineCustomIntVariable("pgq.ticker_period",
+				"Max sleep between ticker runs when queues have new events.",
+				NULL,
+				&ticker_period,
+				1000, 10, 3600 * 1000,
+				PGC_SIGHUP,
+				GUC_UNIT_MS,
+				NULL, NULL, NULL);
+	DefineCustomIntVariable("pgq.maint_period",
+				"Time between maintenance runs.",
+				NULL,
+				&maint_period,
+				120, 1, 24 * 3600,
+				PGC_SIGHUP,
+				GUC_UNIT_S,
+				NULL, NULL, NULL);
+
+	if (!ticker_databases || !ticker_databases[0])
+		return;
+
+	dbnames = pstrdup(ticker_databases);
+	if (!SplitIdentifierString(dbnames, ',', &dblist)) {
+		elog(WARNING, "pgq.ticker_databases: invalid list: %s", ticker_databases);
+		return;
+	}
+
+	foreach(lc, dblist) {
+		MemSet(&worker, 0, sizeof(worker));
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = 10;
+		snprintf(worker.bgw_library_name, sizeof(worker.bgw_library_name), "pgq_lowlevel");
+		snprintf(worker.bgw_function_name, sizeof(worker.bgw_function_name), "pgq_ticker_main");
+		snprintf(worker.bgw_name, sizeof(worker.bgw_name), "pgq ticker %s", (char *) lfirst(lc));
+#if PG_VERSION_NUM >= 110000
+		snprintf(worker.bgw_type, sizeof(worker.bgw_type), "pgq ticker");
+#endif
+		strlcpy(worker.bgw_extra, lfirst(lc), BGW_EXTRALEN);
+		RegisterBackgroundWorker(&worker);
+	}
+}
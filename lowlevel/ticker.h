@@ -0,0 +1 @@
+void pgq_ticker_init(void);
@@ -0,0 +1,199 @@
+/*
+ * txid_filter.c - Check which txids committed between ticks.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+#include "txid_filter.h"
+
+Datum pgq_txid_in_batch(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_txid_in_batch);
+
+struct SnapInfo {
+	int64 xmin;
+	int64 xmax;
+	int nxip;
+	int64 *xip;
+};
+
+/*
+ * Parse txid_snapshot text form: xmin:xmax:xip1,xip2,...
+ * xip list is sorted by output function.
+ */
+static void parse_snapshot(const char *str, struct SnapInfo *snap)
+{
+	const char *p = str;
+	char *end;
+	int n = 1;
+
+	snap->xmin = strtoll(p, &end, 10);
+	if (end == p || *end != ':')
+		goto bad;
+	p = end + 1;
+	snap->xmax = strtoll(p, &end, 10);
+	if (end == p || *end != ':')
+		goto bad;
+	p = end + 1;
+
+	for (end = (char *)p; *end; end++) {
+		if (*end == ',')
+			n++;
+	}
+	snap->xip = palloc(n * sizeof(int64));
+	snap->nxip = 0;
+	while (*p) {
+		snap->xip[snap->nxip++] = strtoll(p, &end, 10);
+		if (end == p)
+			goto bad;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			goto bad;
+		p = end;
+	}
+	return;
+bad:
+	elog(ERROR, "pgq: invalid txid snapshot: %s", str);
+}
+
+/*
+ * Build filter for events between two tick snapshots.
+ */
+struct PgqTxidFilter *pgq_txid_filter_create(const char *last_snapshot, const char *cur_snapshot)
+{
+	struct PgqTxidFilter *f;
+	struct SnapInfo last, cur;
+	uint64 ofs;
+	int i;
+
+	parse_snapshot(last_snapshot, &last);
+	parse_snapshot(cur_snapshot, &cur);
+
+	f = palloc0(sizeof(*f));
+	f->range_start = last.xmax;
+	if (cur.xmax > last.xmax)
+		f->range_len = cur.xmax - last.xmax;
+
+	/* in range, everything except txids running at current tick */
+	if (f->range_len <= PGQ_TXID_BITMAP_MAX) {
+		f->range_bits = palloc((f->range_len + 7) / 8 + 1);
+		memset(f->range_bits, 0xFF, (f->range_len + 7) / 8 + 1);
+		for (i = 0; i < cur.nxip; i++) {
+			if (cur.xip[i] < f->range_start)
+				continue;
+			ofs = cur.xip[i] - f->range_start;
+			f->range_bits[ofs >> 3] &= ~(1 << (ofs & 7));
+		}
+	} else {
+		f->running = palloc((cur.nxip + 1) * sizeof(int64));
+		for (i = 0; i < cur.nxip; i++) {
+			if (cur.xip[i] >= f->range_start)
+				f->running[f->n_running++] = cur.xip[i];
+		}
+	}
+
+	/* below range, only txids that were running at previous tick */
+	f->old = palloc((last.nxip + 1) * sizeof(int64));
+	for (i = 0; i < last.nxip; i++) {
+		if (!pgq_txid_search(cur.xip, cur.nxip, last.xip[i]))
+			f->old[f->n_old++] = last.xip[i];
+	}
+
+	pfree(last.xip);
+	pfree(cur.xip);
+	return f;
+}
+
+/*
+ * Filter cached over calls.  If snapshot arguments are
+ * constants, it is built once per query.
+ */
+struct FilterCache {
+	bool stable;
+	struct varlena *last;
+	struct varlena *cur;
+	struct PgqTxidFilter *filter;
+};
+
+static bool same_snapshot(struct varlena *cached, Datum value)
+{
+	struct varlena *v = PG_DETOAST_DATUM_PACKED(value);
+
+	return VARSIZE_ANY(v) == VARSIZE_ANY(cached)
+		&& memcmp(v, cached, VARSIZE_ANY(v)) == 0;
+}
+
+static struct varlena *copy_snapshot(Datum value)
+{
+	struct varlena *v = PG_DETOAST_DATUM_PACKED(value);
+	struct varlena *res = palloc(VARSIZE_ANY(v));
+
+	memcpy(res, v, VARSIZE_ANY(v));
+	return res;
+}
+
+static char *snapshot_text(FmgrInfo *flinfo, int argno, Datum value)
+{
+	Oid typoutput;
+	bool typisvarlena;
+
+	getTypeOutputInfo(get_fn_expr_argtype(flinfo, argno), &typoutput, &typisvarlena);
+	return OidOutputFunctionCall(typoutput, value);
+}
+
+/*
+ * pgq.txid_in_batch(txid, last_snapshot, cur_snapshot)
+ *
+ * Same as:
+ *   txid_visible_in_snapshot(txid, cur_snapshot)
+ *   and not txid_visible_in_snapshot(txid, last_snapshot)
+ */
+Datum pgq_txid_in_batch(PG_FUNCTION_ARGS)
+{
+	struct FilterCache *cache = fcinfo->flinfo->fn_extra;
+	MemoryContext old_ctx;
+	Datum last = PG_GETARG_DATUM(1);
+	Datum cur = PG_GETARG_DATUM(2);
+
+	if (cache && !cache->stable) {
+		if (!same_snapshot(cache->last, last) || !same_snapshot(cache->cur, cur)) {
+			pfree(cache->last);
+			pfree(cache->cur);
+			pfree(cache);
+			cache = NULL;
+		}
+	}
+
+	if (!cache) {
+		old_ctx = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+		cache = palloc0(sizeof(*cache));
+		cache->stable = get_fn_expr_arg_stable(fcinfo->flinfo, 1)
+			&& get_fn_expr_arg_stable(fcinfo->flinfo, 2);
+		if (!cache->stable) {
+			cache->last = copy_snapshot(last);
+			cache->cur = copy_snapshot(cur);
+		}
+		cache->filter = pgq_txid_filter_create(snapshot_text(fcinfo->flinfo, 1, last),
+						       snapshot_text(fcinfo->flinfo, 2, cur));
+		fcinfo->flinfo->fn_extra = cache;
+		MemoryContextSwitchTo(old_ctx);
+	}
+
+	PG_RETURN_BOOL(pgq_txid_filter_match(cache->filter, PG_GETARG_INT64(0)));
+}
@@ -0,0 +1,57 @@
+/*
+ * Txids that committed between two ticks, precomputed
+ * from tick snapshots for fast per-event check.
+ *
+ * Txid matches if it is visible in current snapshot,
+ * but not in previous one.
+ */
+struct PgqTxidFilter {
+	/* [range_start .. range_start + range_len) - txids started after previous tick */
+	int64 range_start;
+	uint64 range_len;
+	uint8 *range_bits;	/* committed txids in range, NULL if range too large */
+	int64 *running;		/* without bitmap: txids still running at current tick */
+	int n_running;
+
+	/* txids running at previous tick, committed at current one */
+	int64 *old;
+	int n_old;
+};
+
+/* largest range kept as bitmap, in txids */
+#define PGQ_TXID_BITMAP_MAX	(1 << 20)
+
+struct PgqTxidFilter *pgq_txid_filter_create(const char *last_snapshot, const char *cur_snapshot);
+
+/*
+ * Search in sorted array, without unpredictable branches.
+ */
+static inline bool pgq_txid_search(const int64 *arr, int n, int64 txid)
+{
+	const int64 *base = arr;
+	int half;
+
+	if (n <= 0)
+		return false;
+	while (n > 1) {
+		half = n / 2;
+		base = (base[half] <= txid) ? base + half : base;
+		n -= half;
+	}
+	return *base == txid;
+}
+
+static inline bool pgq_txid_filter_match(const struct PgqTxidFilter *f, int64 txid)
+{
+	uint64 ofs;
+
+	if (txid < f->range_start)
+		return pgq_txid_search(f->old, f->n_old, txid);
+
+	ofs = (uint64)(txid - f->range_start);
+	if (ofs >= f->range_len)
+		return false;
+	if (f->range_bits)
+		return (f->range_bits[ofs >> 3] >> (ofs & 7)) & 1;
+	return !pgq_txid_search(f->running, f->n_running, txid);
+}
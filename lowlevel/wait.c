@@ -0,0 +1,355 @@
+/*
+ * wait.c - wait for new ticks without polling.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
+#if PG_VERSION_NUM >= 100000
+#include "pgstat.h"
+#endif
+
+#include "wait.h"
+
+/*
+ * Signalled wait needs ConditionVariableTimedSleep(),
+ * older servers just poll.
+ */
+#if PG_VERSION_NUM >= 130000
+#define PGQ_WAIT
+#include "port/atomics.h"
+#include "storage/condition_variable.h"
+#endif
+
+Datum pgq_wait_batch(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_wait_batch);
+
+Datum pgq_tick_notify(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(pgq_tick_notify);
+
+/* queues share slots by hash, collision only causes extra recheck */
+#define WAIT_SLOTS	256
+
+/* recheck interval when ticks are not signalled */
+#define WAIT_POLL_MSEC	1000
+
+#define NEXT_BATCH_SQL	"select * from pgq.next_batch_info($1, $2)"
+#define QUEUE_ID_SQL	"select queue_id from pgq.queue where queue_name = $1"
+
+#ifdef PGQ_WAIT
+
+/*
+ * Shared slot, tick counter is increased after
+ * tick is committed.
+ */
+struct PgqWaitSlot {
+	pg_atomic_uint64 ticks;
+	ConditionVariable cv;
+};
+
+static struct PgqWaitSlot *wait_slots;
+
+/* slots that get signal on commit */
+static bool pending_slots[WAIT_SLOTS];
+static bool have_pending;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook;
+
+static Size wait_shmem_size(void)
+{
+	return mul_size(WAIT_SLOTS, sizeof(struct PgqWaitSlot));
+}
+
+#if PG_VERSION_NUM >= 150000
+static void wait_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+	RequestAddinShmemSpace(wait_shmem_size());
+}
+#endif
+
+static void wait_shmem_startup(void)
+{
+	bool found;
+	int i;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	wait_slots = ShmemInitStruct("pgq_lowlevel wait", wait_shmem_size(), &found);
+	if (!found) {
+		for (i = 0; i < WAIT_SLOTS; i++) {
+			pg_atomic_init_u64(&wait_slots[i].ticks, 0);
+			ConditionVariableInit(&wait_slots[i].cv);
+		}
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static int slot_index(int32 queue_id)
+{
+	return ((uint32) MyDatabaseId * 131 + (uint32) queue_id) % WAIT_SLOTS;
+}
+
+/*
+ * Wake up waiters after ticks are visible.
+ */
+static void wait_xact_cb(XactEvent event, void *arg)
+{
+	int i;
+
+	if (!have_pending)
+		return;
+
+	if (event == XACT_EVENT_COMMIT) {
+		for (i = 0; i < WAIT_SLOTS; i++) {
+			if (!pending_slots[i])
+				continue;
+			pg_atomic_fetch_add_u64(&wait_slots[i].ticks, 1);
+			ConditionVariableBroadcast(&wait_slots[i].cv);
+		}
+	} else if (event != XACT_EVENT_ABORT) {
+		return;
+	}
+
+	MemSet(pending_slots, 0, sizeof(pending_slots));
+	have_pending = false;
+}
+
+#endif /* PGQ_WAIT */
+
+/*
+ * Register shared memory, works only from shared_preload_libraries.
+ */
+void pgq_wait_init(void)
+{
+#ifdef PGQ_WAIT
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = wait_shmem_request;
+#else
+	RequestAddinShmemSpace(wait_shmem_size());
+#endif
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = wait_shmem_startup;
+
+	RegisterXactCallback(wait_xact_cb, NULL);
+#endif
+}
+
+/*
+ * Sleep until queue gets new tick, or timeout.
+ * May return early, caller must recheck.
+ */
+static void wait_for_tick(void *slot_ptr, uint64 seen, long msec)
+{
+#ifdef PGQ_WAIT
+	struct PgqWaitSlot *slot = slot_ptr;
+
+	if (slot) {
+		ConditionVariablePrepareToSleep(&slot->cv);
+		if (pg_atomic_read_u64(&slot->ticks) == seen)
+			ConditionVariableTimedSleep(&slot->cv, msec, PG_WAIT_EXTENSION);
+		ConditionVariableCancelSleep();
+		return;
+	}
+#endif
+
+	if (msec > WAIT_POLL_MSEC)
+		msec = WAIT_POLL_MSEC;
+#if PG_VERSION_NUM >= 100000
+	if (WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+		      msec, PG_WAIT_EXTENSION) & WL_POSTMASTER_DEATH)
+		proc_exit(1);
+	ResetLatch(MyLatch);
+#else
+	pg_usleep(msec * 1000L);
+#endif
+	CHECK_FOR_INTERRUPTS();
+}
+
+/*
+ * Find wait slot for queue, NULL if not preloaded.
+ */
+static void *find_slot(Datum queue_name)
+{
+#ifdef PGQ_WAIT
+	Oid types[1] = { TEXTOID };
+	bool isnull;
+	int res;
+
+	if (!wait_slots)
+		return NULL;
+
+	res = SPI_execute_with_args(QUEUE_ID_SQL, 1, types, &queue_name, NULL, true, 1);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "pgq.wait_batch: queue query failed: %d", res);
+	if (SPI_processed == 0)
+		return NULL;
+	return &wait_slots[slot_index(DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0],
+								    SPI_tuptable->tupdesc, 1, &isnull)))];
+#else
+	return NULL;
+#endif
+}
+
+static uint64 slot_ticks(void *slot_ptr)
+{
+#ifdef PGQ_WAIT
+	struct PgqWaitSlot *slot = slot_ptr;
+
+	if (slot)
+		return pg_atomic_read_u64(&slot->ticks);
+#endif
+	return 0;
+}
+
+/*
+ * pgq.wait_batch(queue, consumer, timeout)
+ *
+ * Calls pgq.next_batch_info() until it gives batch or timeout
+ * is reached.  Between calls, sleeps until pgq.tick_notify()
+ * signals new tick for the queue.
+ *
+ * Each check needs new snapshot, so transaction snapshot
+ * isolation levels are refused.
+ */
+Datum pgq_wait_batch(PG_FUNCTION_ARGS)
+{
+	Oid types[2] = { TEXTOID, TEXTOID };
+	Datum args[2];
+	Datum values[7];
+	bool nulls[7];
+	MemoryContext fn_ctx = CurrentMemoryContext;
+	MemoryContext old_ctx;
+	TimestampTz end_time;
+	TupleDesc desc;
+	HeapTuple tuple;
+	void *slot = NULL;
+	uint64 seen;
+	long secs;
+	int usecs;
+	int res;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		elog(ERROR, "pgq.wait_batch: queue and consumer name must be given");
+	if (IsolationUsesXactSnapshot())
+		elog(ERROR, "pgq.wait_batch: needs READ COMMITTED isolation");
+	args[0] = PG_GETARG_DATUM(0);
+	args[1] = PG_GETARG_DATUM(1);
+
+	if (get_call_result_type(fcinfo, NULL, &desc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	desc = BlessTupleDesc(desc);
+
+	end_time = GetCurrentTimestamp();
+	if (!PG_ARGISNULL(2))
+		end_time = DatumGetTimestampTz(DirectFunctionCall2(timestamptz_pl_interval,
+								   TimestampTzGetDatum(end_time),
+								   PG_GETARG_DATUM(2)));
+
+	if (SPI_connect() < 0)
+		elog(ERROR, "SPI_connect() failed");
+	slot = find_slot(args[0]);
+	if (SPI_finish() < 0)
+		elog(ERROR, "SPI_finish() failed");
+
+	while (1) {
+		/* read counter before checking, so tick in between is not lost */
+		seen = slot_ticks(slot);
+
+		if (SPI_connect() < 0)
+			elog(ERROR, "SPI_connect() failed");
+		res = SPI_execute_with_args(NEXT_BATCH_SQL, 2, types, args, NULL, false, 1);
+		if (res != SPI_OK_SELECT || SPI_processed != 1)
+			elog(ERROR, "pgq.wait_batch: next_batch_info failed: %d", res);
+		heap_deform_tuple(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, values, nulls);
+		old_ctx = MemoryContextSwitchTo(fn_ctx);
+		tuple = heap_form_tuple(desc, values, nulls);
+		MemoryContextSwitchTo(old_ctx);
+		if (SPI_finish() < 0)
+			elog(ERROR, "SPI_finish() failed");
+
+		/* got batch */
+		if (!nulls[0])
+			break;
+
+		TimestampDifference(GetCurrentTimestamp(), end_time, &secs, &usecs);
+		if (secs == 0 && usecs < 1000)
+			break;
+
+		heap_freetuple(tuple);
+		wait_for_tick(slot, seen, secs * 1000 + usecs / 1000);
+	}
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+/*
+ * Trigger on pgq.tick that wakes up pgq.wait_batch()
+ * callers when transaction commits.
+ */
+Datum pgq_tick_notify(PG_FUNCTION_ARGS)
+{
+	TriggerData *tg;
+#ifdef PGQ_WAIT
+	bool isnull;
+	int col;
+	Datum queue_id;
+#endif
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "pgq.tick_notify() must be called as trigger");
+	tg = (TriggerData *)fcinfo->context;
+	if (!TRIGGER_FIRED_FOR_ROW(tg->tg_event))
+		elog(ERROR, "pgq.tick_notify() must be fired for each row");
+
+#ifdef PGQ_WAIT
+	if (wait_slots) {
+		col = SPI_fnumber(tg->tg_relation->rd_att, "tick_queue");
+		if (col <= 0)
+			elog(ERROR, "pgq.tick_notify: tick_queue column not found");
+		queue_id = heap_getattr(tg->tg_trigtuple, col, tg->tg_relation->rd_att, &isnull);
+		if (!isnull) {
+			pending_slots[slot_index(DatumGetInt32(queue_id))] = true;
+			have_pending = true;
+		}
+	}
+#endif
+
+	PG_RETURN_POINTER(NULL);
+}
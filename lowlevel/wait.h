@@ -0,0 +1 @@
+void pgq_wait_init(void);
@@ -0,0 +1,12 @@
+create or replace function pgq.bintriga() returns trigger as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.bintriga()
+--
+--      MessagePack row encoding needs the C triggers,
+--      PL-only install contains only this stub.
+-- ----------------------------------------------------------------------
+begin
+    raise exception 'pgq.bintriga is not available in PL-only install';
+end;
+$$ language plpgsql;
+
@@ -0,0 +1,102 @@
+create or replace function pgq.get_batch_events(
+    in x_batch_id   bigint,
+    out ev_id       bigint,
+    out ev_time     timestamptz,
+    out ev_txid     bigint,
+    out ev_retry    int4,
+    out ev_type     text,
+    out ev_data     text,
+    out ev_extra1   text,
+    out ev_extra2   text,
+    out ev_extra3   text,
+    out ev_extra4   text)
+returns setof record as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.get_batch_events(1)
+--
+--      Get all events in batch.
+--
+-- Parameters:
+--      x_batch_id      - ID of active batch.
+--
+-- Returns:
+--      List of events.
+-- ----------------------------------------------------------------------
+declare
+    sql text;
+begin
+    sql := pgq.batch_event_sql(x_batch_id);
+    for ev_id, ev_time, ev_txid, ev_retry, ev_type, ev_data,
+        ev_extra1, ev_extra2, ev_extra3, ev_extra4
+        in execute sql
+    loop
+        return next;
+    end loop;
+    return;
+end;
+$$ language plpgsql; -- no perms needed
+
+
+create or replace function pgq.get_batch_events(
+    in x_batch_id   bigint,
+    in x_ordered    boolean,
+    out ev_id       bigint,
+    out ev_time     timestamptz,
+    out ev_txid     bigint,
+    out ev_retry    int4,
+    out ev_type     text,
+    out ev_data     text,
+    out ev_extra1   text,
+    out ev_extra2   text,
+    out ev_extra3   text,
+    out ev_extra4   text)
+returns setof record as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.get_batch_events(2)
+--
+--      Get all events in batch, optionally without ordering.
+--
+-- Parameters:
+--      x_batch_id      - ID of active batch.
+--      x_ordered       - Return events in ev_id order.
+--
+-- Returns:
+--      List of events.
+-- ----------------------------------------------------------------------
+declare
+    sql text;
+begin
+    sql := pgq.batch_event_sql(x_batch_id);
+    if x_ordered is not null and not x_ordered then
+        sql := left(sql, length(sql) - length(' order by 1'));
+    end if;
+    for ev_id, ev_time, ev_txid, ev_retry, ev_type, ev_data,
+        ev_extra1, ev_extra2, ev_extra3, ev_extra4
+        in execute sql
+    loop
+        return next;
+    end loop;
+    return;
+end;
+$$ language plpgsql; -- no perms needed
+
+
+
+
+create or replace function pgq.txid_in_batch(
+    txid bigint, last_snapshot txid_snapshot, cur_snapshot txid_snapshot)
+returns boolean as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.txid_in_batch(3)
+--
+--      Check if transaction committed between two ticks.
+--
+-- Parameters:
+--      txid            - Transaction ID from event
+--      last_snapshot   - Snapshot of previous tick
+--      cur_snapshot    - Snapshot of current tick
+-- ----------------------------------------------------------------------
+    select txid_visible_in_snapshot($1, $3)
+       and not txid_visible_in_snapshot($1, $2);
+$$ language sql immutable strict; -- no perms needed
+
@@ -58,3 +58,127 @@ begin
 end;
 $$ language plpgsql;
 
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.insert_event_batch_raw(7)
+--
+--      Insert several events with one call.  Used by pgq.insert_event_batch().
+--
+-- Parameters:
+--      queue_name      - Name of the queue
+--      ev_type         - user data, array
+--      ev_data         - user data, array
+--      ev_extra1       - user data, array
+--      ev_extra2       - user data, array
+--      ev_extra3       - user data, array
+--      ev_extra4       - user data, array
+--
+--      All non-NULL arrays must be same length, NULL array
+--      means NULL for that field in all events.
+--
+-- Returns:
+--      Number of events inserted.
+-- ----------------------------------------------------------------------
+create or replace function pgq.insert_event_batch_raw(
+    queue_name text, ev_type text[], ev_data text[],
+    ev_extra1 text[], ev_extra2 text[], ev_extra3 text[], ev_extra4 text[])
+returns int4 as $$
+declare
+    qstate record;
+    _qname text;
+    _arr text[];
+    _len int4;
+    _count int4;
+begin
+    -- find batch size
+    for _arr in
+        select a from (values (ev_type), (ev_data), (ev_extra1),
+                              (ev_extra2), (ev_extra3), (ev_extra4)) v (a)
+         where a is not null
+    loop
+        if array_ndims(_arr) > 1 then
+            raise exception 'Batch arrays must be one-dimensional';
+        end if;
+        _len := coalesce(array_length(_arr, 1), 0);
+        if _count is not null and _len <> _count then
+            raise exception 'Batch arrays must be same length';
+        end if;
+        _count := _len;
+    end loop;
+    if coalesce(_count, 0) = 0 then
+        return 0;
+    end if;
+
+    _qname := queue_name;
+    select q.queue_id,
+        pgq.quote_fqname(q.queue_data_pfx || '_' || q.queue_cur_table::text) as cur_table_name,
+        q.queue_event_seq,
+        q.queue_disable_insert
+    from pgq.queue q where q.queue_name = _qname into qstate;
+    if not found then
+        raise exception 'No such queue';
+    end if;
+
+    if qstate.queue_disable_insert then
+        if current_setting('session_replication_role') <> 'replica' then
+            raise exception 'Insert into queue disallowed';
+        end if;
+    end if;
+
+    execute 'insert into ' || qstate.cur_table_name
+        || ' (ev_id, ev_time, ev_owner, ev_retry,'
+        || ' ev_type, ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4)'
+        || ' select nextval($1), $2, null, null, ev.*'
+        || ' from unnest($3, $4, $5, $6, $7, $8) as ev'
+        using qstate.queue_event_seq, now(),
+              ev_type, ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4;
+
+    return _count;
+end;
+$$ language plpgsql;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.queue_cache_invalidate()
+--
+--      Trigger function on pgq.queue.  PL/pgSQL insert functions
+--      do not cache queue info, so nothing to do here.
+-- ----------------------------------------------------------------------
+create or replace function pgq.queue_cache_invalidate()
+returns trigger as $$
+begin
+    return null;
+end;
+$$ language plpgsql;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.stat_queues_raw(0)
+--
+--      Insert statistics are kept only by C functions,
+--      return empty set.
+-- ----------------------------------------------------------------------
+create or replace function pgq.stat_queues_raw(
+    out queue_id integer, out events bigint, out bytes bigint,
+    out max_event_size bigint, out tx_limit_rejects bigint,
+    out disabled_rejects bigint, out insert_latency_hist bigint[])
+returns setof record as $$
+begin
+    return;
+end;
+$$ language plpgsql;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.stat_queues_reset(0)
+--
+--      Insert statistics are kept only by C functions,
+--      nothing to do.
+-- ----------------------------------------------------------------------
+create or replace function pgq.stat_queues_reset()
+returns void as $$
+begin
+    return;
+end;
+$$ language plpgsql;
@@ -167,10 +167,16 @@ begin
         pkey_change_sql text;
         pkey_col_changes int4 := 0;
         valexp text;
+        native_types oid[] := array['timestamptz', 'timestamp', 'date', 'boolean',
+                                    'int8', 'int4', 'int2', 'float4', 'float8', 'numeric',
+                                    'uuid', 'json', 'jsonb']::regtype[]::oid[];
+        array_types oid[] := array['int8', 'float4', 'float8', 'numeric',
+                                   'uuid', 'json', 'jsonb']::regtype[]::oid[];
     begin
         for attr in
-            select k.attnum, k.attname, k.atttypid
-                from pg_attribute k
+            select k.attnum, k.attname, k.atttypid,
+                   case when t.typlen = -1 then t.typelem else 0::oid end as elemtypid
+                from pg_attribute k join pg_type t on (t.oid = k.atttypid)
                 where k.attrelid = TG_RELID and k.attnum > 0 and not k.attisdropped
                 order by k.attnum
         loop
@@ -189,11 +195,12 @@ begin
                 continue;
             end if;
 
-            -- force cast to text or not
-            if attr.atttypid in ('timestamptz'::regtype::oid, 'timestamp'::regtype::oid,
-                    'int8'::regtype::oid, 'int4'::regtype::oid, 'int2'::regtype::oid,
-                    'date'::regtype::oid, 'boolean'::regtype::oid) then
+            -- force cast to text or not, 1-D arrays of some types become json arrays
+            if attr.atttypid = any (native_types) then
                 valexp := 'to_json(r.' || qcol || ')::text';
+            elsif attr.elemtypid = any (array_types) then
+                valexp := 'case when array_ndims(r.' || qcol || ') > 1 then to_json(r.' || qcol || '::text)'
+                       || ' else to_json(r.' || qcol || ') end::text';
             else
                 valexp := 'to_json(r.' || qcol || '::text)::text';
             end if;
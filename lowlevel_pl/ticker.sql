@@ -0,0 +1,34 @@
+create or replace function pgq.ticker() returns bigint as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.ticker(0)
+--
+--     Creates ticks for all unpaused queues which dont have external ticker.
+--
+--     PL version calls pgq.ticker(1) for each queue.
+--
+--     Called by pgqd, or by background worker in pgq_lowlevel when
+--     it is in shared_preload_libraries and database is listed
+--     in pgq.ticker_databases setting.
+--
+-- Returns:
+--     Number of queues that were processed.
+-- ----------------------------------------------------------------------
+declare
+    res bigint;
+    q record;
+begin
+    res := 0;
+    for q in
+        select queue_name from pgq.queue
+            where not queue_external_ticker
+                  and not queue_ticker_paused
+            order by queue_name
+    loop
+        if pgq.ticker(q.queue_name) > 0 then
+            res := res + 1;
+        end if;
+    end loop;
+    return res;
+end;
+$$ language plpgsql security definer;
+
@@ -0,0 +1,72 @@
+create or replace function pgq.wait_batch(
+    in i_queue_name text,
+    in i_consumer_name text,
+    in i_timeout interval,
+    out batch_id int8,
+    out cur_tick_id int8,
+    out prev_tick_id int8,
+    out cur_tick_time timestamptz,
+    out prev_tick_time timestamptz,
+    out cur_tick_event_seq int8,
+    out prev_tick_event_seq int8)
+as $$
+-- ----------------------------------------------------------------------
+-- Function: pgq.wait_batch(3)
+--
+--      Same as pgq.next_batch_info(), but if there is no batch
+--      available, waits until there is one or timeout is reached.
+--
+--      PL version rechecks once a second.
+--
+--      Must be called in READ COMMITTED isolation, outside of
+--      transaction that has written anything, see C version.
+--
+-- Parameters:
+--      i_queue_name        - Name of the queue
+--      i_consumer_name     - Name of the consumer
+--      i_timeout           - How long to wait for batch
+--
+-- Returns:
+--      Same as pgq.next_batch_info(), batch_id is NULL on timeout.
+-- ----------------------------------------------------------------------
+declare
+    end_time timestamptz;
+    left_secs float8;
+begin
+    if current_setting('transaction_isolation') in ('repeatable read', 'serializable') then
+        raise exception 'pgq.wait_batch: needs READ COMMITTED isolation';
+    end if;
+    end_time := clock_timestamp() + coalesce(i_timeout, '0');
+    loop
+        select f.batch_id, f.cur_tick_id, f.prev_tick_id,
+               f.cur_tick_time, f.prev_tick_time,
+               f.cur_tick_event_seq, f.prev_tick_event_seq
+            into batch_id, cur_tick_id, prev_tick_id, cur_tick_time, prev_tick_time,
+                 cur_tick_event_seq, prev_tick_event_seq
+            from pgq.next_batch_info(i_queue_name, i_consumer_name) f;
+        if batch_id is not null then
+            return;
+        end if;
+        left_secs := extract(epoch from end_time - clock_timestamp());
+        if left_secs < 0.001 then
+            return;
+        end if;
+        perform pg_sleep(least(left_secs, 1));
+    end loop;
+end;
+$$ language plpgsql;
+
+
+-- ----------------------------------------------------------------------
+-- Function: pgq.tick_notify()
+--
+--      Trigger function on pgq.tick.  PL/pgSQL pgq.wait_batch()
+--      polls, so nothing to do here.
+-- ----------------------------------------------------------------------
+create or replace function pgq.tick_notify()
+returns trigger as $$
+begin
+    return null;
+end;
+$$ language plpgsql;
+
@@ -0,0 +1,27 @@
+# Queue info cached by pgq.insert_event() must not be taken
+# from snapshot of transaction that started before rotation.
+
+setup
+{
+    select pgq.create_queue('cachequeue');
+    select pgq.set_queue_config('cachequeue', 'rotation_period', '0');
+}
+
+teardown
+{
+    select pgq.drop_queue('cachequeue', true);
+}
+
+session s1
+step s1_insert       { select pgq.insert_event('cachequeue', 'cachetest', 'before') > 0 as ok; }
+step s1_begin        { begin isolation level repeatable read; }
+step s1_xid          { select txid_current() > 0 as has_txid; }
+step s1_insert_rr    { select pgq.insert_event('cachequeue', 'cachetest', 'rr') > 0 as ok; }
+step s1_commit       { commit; }
+step s1_insert_after { select pgq.insert_event('cachequeue', 'cachetest', 'after') > 0 as ok; }
+step s1_check        { select ev_data, tableoid = pgq.current_event_table('cachequeue')::regclass as in_cur_table from pgq.event_template where ev_type = 'cachetest' order by ev_id; }
+
+session s2
+step s2_rotate       { select pgq.maint_rotate_tables_step1('cachequeue') = 0 as ok; }
+
+permutation s1_insert s1_begin s1_xid s2_rotate s1_insert_rr s1_commit s1_insert_after s1_check
@@ -14,9 +14,15 @@ select pgq.register_consumer('myqueue', 'consumer');
 update pgq.queue set queue_ticker_max_lag = '0', queue_ticker_idle_period = '0';
 select pgq.next_batch('myqueue', 'consumer');
 select pgq.next_batch('myqueue', 'consumer');
+select batch_id from pgq.wait_batch('myqueue', 'consumer', '10 ms');
+-- wait needs new snapshot for each check
+begin isolation level repeatable read;
+select batch_id from pgq.wait_batch('myqueue', 'consumer', '10 ms');
+rollback;
 select pgq.ticker();
 select pgq.next_batch('myqueue', 'consumer');
 select pgq.next_batch('myqueue', 'consumer');
+select batch_id from pgq.wait_batch('myqueue', 'consumer', '1 hour');
 
 select queue_name, consumer_name, prev_tick_id, tick_id, lag < '30 seconds' as lag_exists from pgq.get_batch_info(1);
 
@@ -51,6 +57,7 @@ select * from pgq.next_batch_custom('myqueue', 'consumer', null, 10000, null);
 select * from pgq.next_batch_custom('myqueue', 'consumer', null, null, '10 minutes');
 select pgq.next_batch('myqueue', 'consumer');
 select ev_id,ev_retry,ev_type,ev_data,ev_extra1,ev_extra2,ev_extra3,ev_extra4 from pgq.get_batch_events(3);
+select ev_id, ev_type from pgq.get_batch_events(3, false) order by 1;
 
 begin;
 select ev_id,ev_retry,ev_type,ev_data,ev_extra1,ev_extra2,ev_extra3,ev_extra4
@@ -97,4 +104,18 @@ select * from pgq.maint_operations();
 update pgq.queue set queue_extra_maint = array['baz', 'foo.bar'];
 select * from pgq.maint_operations();
 
+-- stats are collected only when preloaded
+select queue_name, events from pgq.stat_queues;
+select pgq.stat_queues_reset();
+
+-- batch visibility check, small range uses bitmap, large one search
+select s.cur::text, count(*) filter (where pgq.txid_in_batch(t, s.last, s.cur)) as in_batch,
+       count(*) filter (where pgq.txid_in_batch(t, s.last, s.cur)
+                              <> (txid_visible_in_snapshot(t, s.cur)
+                                  and not txid_visible_in_snapshot(t, s.last))) as mismatch
+  from (values ('10:20:12,15'::txid_snapshot, '14:30:14,25'::txid_snapshot),
+               ('10:20:12,15'::txid_snapshot, '14:2000030:14,25'::txid_snapshot)) s (last, cur),
+       generate_series(1, 40) t
+ group by 1 order by 1;
+
 select pgq.drop_queue('myqueue', true);
@@ -0,0 +1,42 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('adaptqueue');
+select pgq.set_queue_config('adaptqueue', 'ticker_max_count', '1');
+select pgq.register_consumer('adaptqueue', 'adaptcons');
+select pgq.insert_event('adaptqueue', 'ev', 'data1');
+select pgq.ticker('adaptqueue') is not null as ticked;
+
+create temp view adapt_sub as
+    select s.sub_batch as batch_id, s.sub_batch_time
+      from pgq.subscription s, pgq.consumer c where c.co_id = s.sub_consumer and c.co_name = 'adaptcons';
+
+-- batch time is measured by wall clock, also inside single transaction
+begin;
+select pgq.next_batch('adaptqueue', 'adaptcons') is not null as has_batch;
+select pgq.finish_batch(batch_id) from adapt_sub;
+commit;
+select sub_batch_time > '0' as has_batch_time from adapt_sub;
+
+-- tick when batch reaches target size
+select pgq.set_queue_config('adaptqueue', 'ticker_max_count', '1000');
+select pgq.set_queue_config('adaptqueue', 'ticker_max_lag', '1 hour');
+select pgq.insert_event('adaptqueue', 'ev', 'data' || i::text) from generate_series(2, 4) i;
+select pgq.ticker('adaptqueue') is not null as ticked;
+select pgq.set_queue_config('adaptqueue', 'ticker_target_count', '3');
+select pgq.ticker('adaptqueue') is not null as ticked;
+select tick_event_rate > 0 as has_rate from pgq.tick
+ where tick_queue = (select queue_id from pgq.queue where queue_name = 'adaptqueue')
+ order by tick_id desc limit 1;
+
+-- event rate alone does not tick below target
+update pgq.tick t set tick_event_rate = 1000000
+  from pgq.queue q
+ where q.queue_name = 'adaptqueue' and t.tick_queue = q.queue_id
+   and t.tick_id = (select max(tick_id) from pgq.tick where tick_queue = q.queue_id);
+select pgq.insert_event('adaptqueue', 'ev', 'data5');
+select pgq.ticker('adaptqueue') is not null as ticked;
+
+drop view adapt_sub;
+select pgq.drop_queue('adaptqueue', true);
+
@@ -0,0 +1,20 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('batchqueue');
+
+select pgq.insert_event_batch('batchqueue', array['t1', 't2', 't3'], array['d1', 'd2', 'd3']);
+select pgq.insert_event_batch('batchqueue', array['t4', 't5'], array['d4', null],
+        array['x4', 'x5'], null, null, array[null, 'z5']);
+
+-- bad input
+select pgq.insert_event_batch('batchqueue', array['t6'], array['d6', 'd7']);
+select pgq.insert_event_batch('batchqueue', array[['t6']], array[['d6']]);
+select pgq.insert_event_batch('batchqueue', null, array[]::text[]);
+
+select ev_id, ev_owner, ev_retry, ev_type, ev_data, ev_extra1, ev_extra2, ev_extra3, ev_extra4
+  from pgq.event_template
+ where tableoid = pgq.current_event_table('batchqueue')::regclass
+ order by ev_id;
+
+select pgq.drop_queue('batchqueue');
@@ -0,0 +1,38 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('bufqueue');
+select pgq.set_queue_config('bufqueue', 'buffer_events', 'true');
+
+-- events from aborted subtransactions are dropped
+begin;
+select pgq.insert_event('bufqueue', 'ev', 'data1');
+savepoint sp1;
+select pgq.insert_event('bufqueue', 'ev', 'data2');
+rollback to savepoint sp1;
+savepoint sp2;
+select pgq.insert_event('bufqueue', 'ev', 'data3');
+release savepoint sp2;
+commit;
+
+-- events from aborted transaction are dropped
+begin;
+select pgq.insert_event('bufqueue', 'ev', 'data4');
+rollback;
+
+select ev_id, ev_type, ev_data
+  from pgq.event_template
+ where tableoid = pgq.current_event_table('bufqueue')::regclass
+ order by ev_id;
+
+-- buffer is written out in parts
+begin;
+select count(pgq.insert_event('bufqueue', 'bulk', i::text)) from generate_series(1, 2500) i;
+commit;
+
+select ev_type, count(*), min(ev_id), max(ev_id)
+  from pgq.event_template
+ where tableoid = pgq.current_event_table('bufqueue')::regclass
+ group by 1 order by 1;
+
+select pgq.drop_queue('bufqueue');
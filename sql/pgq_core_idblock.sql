@@ -0,0 +1,29 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('blockqueue');
+select pgq.set_queue_config('blockqueue', 'event_id_block', '100');
+select pgq.set_queue_config('blockqueue', 'ticker_max_count', '1');
+select pgq.set_queue_config('blockqueue', 'event_id_block', '0');
+
+-- each nextval reserves block of ids, sequence is at its end
+select pgq.insert_event('blockqueue', 'ev', 'data1');
+select pgq.insert_event('blockqueue', 'ev', 'data2') <= 101 as in_block;
+select pgq.seq_getval(queue_event_seq) from pgq.queue where queue_name = 'blockqueue';
+select pgq.ticker('blockqueue') is not null as ticked;
+
+-- C inserts take next ids from the block, ticker must notice them
+select pgq.insert_event_batch('blockqueue', array['ev', 'ev'], array['data3', 'data4']);
+select pgq.ticker('blockqueue') is not null as ticked;
+
+-- no new events
+select pgq.ticker('blockqueue') is not null as ticked;
+
+-- ids are unique and not above sequence
+select count(*), count(distinct ev_id),
+       max(ev_id) <= (select pgq.seq_getval(queue_event_seq) from pgq.queue
+                       where queue_name = 'blockqueue') as below_seq
+  from pgq.event_template
+ where tableoid = pgq.current_event_table('blockqueue')::regclass;
+
+select pgq.drop_queue('blockqueue');
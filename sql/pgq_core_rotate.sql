@@ -0,0 +1,41 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('rotqueue');
+select pgq.set_queue_config('rotqueue', 'ticker_max_count', '1');
+select pgq.set_queue_config('rotqueue', 'rotation_period', '0');
+select pgq.register_consumer('rotqueue', 'rotcons');
+
+create temp view rot_batch as
+    select s.sub_batch as batch_id
+      from pgq.subscription s, pgq.consumer c where c.co_id = s.sub_consumer and c.co_name = 'rotcons';
+
+-- move consumer past queue creation, so rotation is not blocked
+select pgq.insert_event('rotqueue', 'ev', 'first');
+select pgq.ticker('rotqueue') is not null as ticked;
+select pgq.next_batch('rotqueue', 'rotcons') is not null as has_batch;
+select pgq.finish_batch(batch_id) from rot_batch;
+
+-- ev_id order interleaves between tables
+select pgq.insert_event_raw('rotqueue', 11, now(), null, null, 'ev', 'old11', null, null, null, null);
+select pgq.insert_event_raw('rotqueue', 13, now(), null, null, 'ev', 'old13', null, null, null, null);
+select pgq.maint_rotate_tables_step1('rotqueue');
+select queue_cur_table from pgq.queue where queue_name = 'rotqueue';
+select pgq.insert_event_raw('rotqueue', 12, now(), null, null, 'ev', 'new12', null, null, null, null);
+select pgq.insert_event_raw('rotqueue', 14, now(), null, null, 'ev', 'new14', null, null, null, null);
+select pgq.ticker('rotqueue') is not null as ticked;
+
+-- batch spans rotation, events must come merged
+select pgq.next_batch('rotqueue', 'rotcons') is not null as has_batch;
+select count(*) from pgq.batch_event_tables((select batch_id from rot_batch));
+select ev_id, ev_data from pgq.get_batch_events((select batch_id from rot_batch));
+
+begin;
+select ev_id, ev_data from pgq.get_batch_cursor((select batch_id from rot_batch), 'rcurs', 10);
+close rcurs;
+select ev_id, ev_data from pgq.get_batch_cursor((select batch_id from rot_batch), 'rcurs', 10, 'ev_id > 11');
+close rcurs;
+end;
+
+select pgq.finish_batch(batch_id) from rot_batch;
+select pgq.drop_queue('rotqueue');
@@ -0,0 +1,37 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('splitqueue');
+select pgq.set_queue_config('splitqueue', 'ticker_max_count', '1');
+select pgq.register_consumer('splitqueue', 'splitcons');
+select pgq.insert_event('splitqueue', 'ev', 'data' || i::text) from generate_series(1, 5) i;
+select pgq.ticker('splitqueue') is not null as ticked;
+
+create temp view split_batch as
+    select s.sub_batch as batch_id, s.sub_batch_start_id, s.sub_batch_end_id
+      from pgq.subscription s, pgq.consumer c where c.co_id = s.sub_consumer and c.co_name = 'splitcons';
+
+-- 5 events in parts of 2
+select batch_id is not null as has_batch from pgq.next_batch_custom('splitqueue', 'splitcons', null, null, null, 2);
+select sub_batch_start_id, sub_batch_end_id from split_batch;
+select ev_id, ev_data from pgq.get_batch_events((select batch_id from split_batch));
+select pgq.finish_batch(batch_id) from split_batch;
+
+select batch_id is not null as has_batch from pgq.next_batch_custom('splitqueue', 'splitcons', null, null, null, 2);
+select sub_batch_start_id, sub_batch_end_id from split_batch;
+select ev_id, ev_data from pgq.get_batch_events((select batch_id from split_batch));
+select pgq.finish_batch(batch_id) from split_batch;
+
+select batch_id is not null as has_batch from pgq.next_batch_custom('splitqueue', 'splitcons', null, null, null, 2);
+select sub_batch_start_id, sub_batch_end_id from split_batch;
+select ev_id, ev_data from pgq.get_batch_events((select batch_id from split_batch));
+select pgq.finish_batch(batch_id) from split_batch;
+
+-- all parts done, consumer is on next tick
+select batch_id is not null as has_batch from pgq.next_batch_custom('splitqueue', 'splitcons', null, null, null, 2);
+select sub_batch_start_id, sub_batch_end_id from split_batch;
+select * from pgq.next_batch_custom('splitqueue', 'splitcons', null, null, null, 0);
+
+drop view split_batch;
+select pgq.drop_queue('splitqueue', true);
+
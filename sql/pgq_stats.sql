@@ -0,0 +1,18 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+-- counters are kept only when pgq_lowlevel is in shared_preload_libraries,
+-- otherwise view is empty (expected/pgq_stats_1.out)
+select pgq.create_queue('statqueue');
+select pgq.stat_queues_reset();
+select pgq.insert_event('statqueue', 'ev', 'data1');
+select pgq.insert_event_batch('statqueue', array['ev', 'ev'], array['data2', 'data33']);
+select queue_name, events, bytes, max_event_size,
+       (select sum(x) from unnest(insert_latency_hist) x) as calls
+  from pgq.stat_queues where queue_name = 'statqueue';
+
+-- reset frees entries of dropped queues
+select pgq.drop_queue('statqueue');
+select pgq.stat_queues_reset();
+select count(*) from pgq.stat_queues_raw() s
+ where not exists (select 1 from pgq.queue q where q.queue_id = s.queue_id);
@@ -0,0 +1,38 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+create or replace function pgq.insert_event(queue_name text, ev_type text, ev_data text, ev_extra1 text, ev_extra2 text, ev_extra3 text, ev_extra4 text)
+returns bigint as $$
+begin
+    raise warning 'insert_event(q=[%], t=[%], d=[%], 1=[%], 2=[%])',
+        queue_name, ev_type, ev_data, ev_extra1, ev_extra2;
+    return 1;
+end;
+$$ language plpgsql;
+
+create table trigger_bin (
+    nr int4 primary key,
+    txt text,
+    flag bool,
+    big int8,
+    ratio float8,
+    raw bytea,
+    ts timestamp,
+    amount numeric
+);
+
+create trigger bin_trig_0 after insert or update or delete on trigger_bin
+for each row execute procedure pgq.bintriga('bintriga', 'backup');
+
+create trigger bin_trig_1 after insert or update or delete on trigger_bin
+for each row execute procedure pgq.bintriga('bintriga_delta', 'delta', 'ignore=raw');
+
+insert into trigger_bin values (1, 'a', true, -5000000000, 1.5, '\x0102', '2000-01-01 00:00:01', 10.50);
+update trigger_bin set txt = 'b', flag = null where nr = 1;
+update trigger_bin set raw = '\x03' where nr = 1;
+delete from trigger_bin where nr = 1;
+
+-- restore
+drop table trigger_bin;
+\set ECHO none
+\i functions/pgq.insert_event.sql
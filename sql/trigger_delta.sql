@@ -0,0 +1,44 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+create or replace function pgq.insert_event(queue_name text, ev_type text, ev_data text, ev_extra1 text, ev_extra2 text, ev_extra3 text, ev_extra4 text)
+returns bigint as $$
+begin
+    raise warning 'insert_event(q=[%], t=[%], d=[%], 2=[%])',
+        queue_name, ev_type, ev_data, ev_extra2;
+    return 1;
+end;
+$$ language plpgsql;
+
+create table trigger_delta (nr int4 primary key, col1 text, col2 text, col3 int4);
+
+create trigger delta_trig_0 after insert or update or delete on trigger_delta
+for each row execute procedure pgq.jsontriga('jsontriga', 'delta', 'backup');
+
+create trigger delta_trig_1 after insert or update or delete on trigger_delta
+for each row execute procedure pgq.logutriga('logutriga', 'delta', 'ignore=col3');
+
+insert into trigger_delta values (1, 'a', 'b', 1);
+update trigger_delta set col1 = 'ax' where nr = 1;
+update trigger_delta set col2 = null, col3 = 2 where nr = 1;
+update trigger_delta set col3 = 3 where nr = 1;
+update trigger_delta set col1 = 'ax' where nr = 1;
+delete from trigger_delta where nr = 1;
+
+-- toasted values
+create table trigger_delta_toast (nr int4 primary key, val text, big text);
+alter table trigger_delta_toast alter column big set storage external;
+
+create trigger delta_trig_0 after insert or update or delete on trigger_delta_toast
+for each row execute procedure pgq.jsontriga('jsontriga', 'delta', 'ignore=big');
+
+insert into trigger_delta_toast values (1, 'a', repeat('x', 10000));
+update trigger_delta_toast set val = 'b' where nr = 1;
+update trigger_delta_toast set big = big || '' where nr = 1;
+update trigger_delta_toast set big = big || 'y' where nr = 1;
+
+-- restore
+drop table trigger_delta;
+drop table trigger_delta_toast;
+\set ECHO none
+\i functions/pgq.insert_event.sql
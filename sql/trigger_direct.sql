@@ -0,0 +1,23 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+select pgq.create_queue('directqueue');
+
+create table trigger_direct (id int4 primary key, val text);
+create trigger direct_trig after insert or update or delete on trigger_direct
+for each row execute procedure pgq.jsontriga('directqueue');
+
+-- insert without pgq.insert_event() wrapper
+set pgq.trigger_direct_insert = on;
+insert into trigger_direct values (1, 'a');
+update trigger_direct set val = 'b';
+delete from trigger_direct;
+reset pgq.trigger_direct_insert;
+
+select ev_type, ev_data, ev_extra1
+  from pgq.event_template
+ where tableoid = pgq.current_event_table('directqueue')::regclass
+ order by ev_id;
+
+drop table trigger_direct;
+select pgq.drop_queue('directqueue');
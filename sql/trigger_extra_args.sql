@@ -34,8 +34,25 @@ update trigger_extra_args set col1 = 'col1x', col2='col2x' where nr=1;
 -- test delete
 delete from trigger_extra_args where nr=1;
 
+-- expression follows search_path
+create schema qb_a;
+create schema qb_b;
+create function qb_a.qb_tag() returns text as $$ select 'a'::text $$ language sql;
+create function qb_b.qb_tag() returns text as $$ select 'b'::text $$ language sql;
+create table trigger_extra_path (nr int4 primary key);
+create trigger extra_path_trig after insert on trigger_extra_path
+for each row execute procedure pgq.logutriga('logutriga', 'ev_extra1=qb_tag()');
+set search_path = qb_a, public;
+insert into trigger_extra_path values (1);
+set search_path = qb_b, public;
+insert into trigger_extra_path values (2);
+reset search_path;
+
 -- restore
 drop table trigger_extra_args;
+drop table trigger_extra_path;
+drop schema qb_a cascade;
+drop schema qb_b cascade;
 \set ECHO none
 \i functions/pgq.insert_event.sql
 
@@ -32,6 +32,11 @@ update trigger_ignore set col2 = 'col2z' where dat1 = 'a';
 -- test null update
 update trigger_ignore set col2 = col2 where dat1 = 'a';
 
+-- test cached column info after table change
+alter table trigger_ignore drop column col1;
+alter table trigger_ignore add column col3 text;
+update trigger_ignore set col3 = 'col3' where dat1 = 'a';
+
 -- restore
 drop table trigger_ignore;
 \set ECHO none
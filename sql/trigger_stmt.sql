@@ -0,0 +1,35 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+create or replace function pgq.insert_event_batch(queue_name text, ev_type text[], ev_data text[], ev_extra1 text[], ev_extra2 text[], ev_extra3 text[], ev_extra4 text[])
+returns integer as $$
+declare
+    i integer;
+begin
+    for i in 1 .. array_length(ev_type, 1) loop
+        raise warning 'insert_event_batch(q=[%], t=[%], d=[%], 1=[%], 2=[%], 3=[%], 4=[%])',
+            queue_name, ev_type[i], ev_data[i], ev_extra1[i], ev_extra2[i], ev_extra3[i], ev_extra4[i];
+    end loop;
+    return array_length(ev_type, 1);
+end;
+$$ language plpgsql;
+
+create table trigger_stmt (id int4 primary key, val text);
+
+create trigger stmt_ins after insert on trigger_stmt referencing new table as newtbl for each statement execute procedure pgq.jsontriga('jsontriga');
+create trigger stmt_upd after update on trigger_stmt referencing old table as oldtbl new table as newtbl for each statement execute procedure pgq.logutriga('logutriga', 'backup');
+create trigger stmt_del after delete on trigger_stmt referencing old table as oldtbl for each statement execute procedure pgq.jsontriga('jsontriga');
+
+-- events from transition tables
+insert into trigger_stmt values (1, 'a'), (2, 'b');
+update trigger_stmt set val = val || 'x';
+delete from trigger_stmt where id = 1;
+
+-- statement trigger without transition table
+create trigger stmt_bad after insert on trigger_stmt for each statement execute procedure pgq.jsontriga('jsontriga');
+insert into trigger_stmt values (3, 'c');
+
+-- restore
+drop table trigger_stmt;
+\set ECHO none
+\i functions/pgq.insert_event_batch.sql
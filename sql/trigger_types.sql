@@ -82,6 +82,9 @@ select typetest('box', '((1.1, 2.1), (5.6, 5.7))');
 select typetest('uuid', 'a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11');
 select typetest('json', '{"a": [false, null, true]}');
 select typetest('json', '[1,2,3]');
+select typetest('jsonb', '{"b": 2, "a": [1, "x"]}');
+select typetest('float', 'NaN');
+select typetest('numeric', 'NaN');
 
 -- restore
 drop function typetest(text,text);
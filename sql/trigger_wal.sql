@@ -0,0 +1,56 @@
+\set VERBOSITY 'terse'
+set client_min_messages = 'warning';
+
+create or replace function pgq.insert_event_batch(queue_name text, ev_type text[], ev_data text[], ev_extra1 text[], ev_extra2 text[], ev_extra3 text[], ev_extra4 text[])
+returns integer as $$
+declare
+    i integer;
+begin
+    for i in 1 .. array_length(ev_type, 1) loop
+        raise warning 'insert_event_batch(q=[%], t=[%], d=[%], 1=[%], 2=[%])',
+            queue_name, ev_type[i], ev_data[i], ev_extra1[i], ev_extra2[i];
+    end loop;
+    return array_length(ev_type, 1);
+end;
+$$ language plpgsql;
+
+create table trigger_wal (nr int4 primary key, val text);
+create table trigger_wal_skip (nr int4 primary key);
+
+select count(*) from pg_create_logical_replication_slot('pgq_test_wal', 'pgq_triggers');
+
+insert into trigger_wal values (1, 'a'), (2, 'b');
+insert into trigger_wal_skip values (1);
+update trigger_wal set val = 'c' where nr = 1;
+delete from trigger_wal where nr = 2;
+
+select pgq.insert_wal_events('wal_json', 'pgq_test_wal', 'public.trigger_wal');
+
+-- applied changes are skipped
+select pgq.insert_wal_events('wal_json', 'pgq_test_wal', 'public.trigger_wal');
+
+update trigger_wal set val = 'd' where nr = 1;
+truncate trigger_wal;
+select pgq.insert_wal_events('wal_urlenc', 'pgq_test_wal', 'public.trigger_wal', 'urlenc');
+
+-- full row for delete
+alter table trigger_wal replica identity full;
+insert into trigger_wal values (3, 'e');
+delete from trigger_wal where nr = 3;
+select pgq.insert_wal_events('wal_json', 'pgq_test_wal', 'public.trigger_wal');
+
+-- rolled back changes are seen again
+insert into trigger_wal values (4, 'f');
+begin;
+select pgq.insert_wal_events('wal_json', 'pgq_test_wal', 'public.trigger_wal');
+rollback;
+select pgq.insert_wal_events('wal_json', 'pgq_test_wal', 'public.trigger_wal');
+select pgq.insert_wal_events('wal_json', 'pgq_test_wal', 'public.trigger_wal');
+
+-- restore
+select count(*) from pg_drop_replication_slot('pgq_test_wal');
+delete from pgq.wal_position where wal_slot_name = 'pgq_test_wal';
+drop table trigger_wal;
+drop table trigger_wal_skip;
+\set ECHO none
+\i functions/pgq.insert_event_batch.sql
@@ -23,8 +23,18 @@ for each row execute procedure pgq.sqltriga('sqltriga', 'when=col2=''foo''');
 insert into trigger_when values (1, 'col1', 'col2');
 insert into trigger_when values (2, 'col1', 'foo');
 
+-- same expression on other table, expression with subquery
+create table trigger_when2 (col2 text, nr int4 primary key);
+create trigger when2_trig_0 after insert or update or delete on trigger_when2
+for each row execute procedure pgq.jsontriga('jsontriga', 'when=col2=''foo''');
+create trigger when2_trig_1 after insert or update or delete on trigger_when2
+for each row execute procedure pgq.jsontriga('jsontriga_sub', 'when=col2 in (select ''foo'')', 'ev_extra3=nr * 2');
+insert into trigger_when2 values ('bar', 1);
+insert into trigger_when2 values ('foo', 2);
+
 -- restore
 drop table trigger_when;
+drop table trigger_when2;
 \set ECHO none
 \i functions/pgq.insert_event.sql
 
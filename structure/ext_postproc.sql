@@ -7,6 +7,7 @@ SELECT pg_catalog.pg_extension_config_dump('pgq.tick', '');
 SELECT pg_catalog.pg_extension_config_dump('pgq.subscription', '');
 SELECT pg_catalog.pg_extension_config_dump('pgq.event_template', '');
 SELECT pg_catalog.pg_extension_config_dump('pgq.retry_queue', '');
+SELECT pg_catalog.pg_extension_config_dump('pgq.wal_position', '');
 
 -- This needs pg_dump 9.1.7+
 SELECT pg_catalog.pg_extension_config_dump('pgq.batch_id_seq', '');
@@ -45,7 +45,9 @@
 -- Group: Event publishing
 
 \i functions/pgq.insert_event.sql
+\i functions/pgq.insert_event_batch.sql
 \i functions/pgq.current_event_table.sql
+\i functions/pgq.insert_wal_events.sql
 
 -- Group: Subscribing to queue
 
@@ -55,7 +57,6 @@
 -- Group: Batch processing
 
 \i functions/pgq.next_batch.sql
-\i functions/pgq.get_batch_events.sql
 \i functions/pgq.get_batch_cursor.sql
 \i functions/pgq.event_retry.sql
 \i functions/pgq.batch_retry.sql
@@ -67,4 +68,5 @@
 \i functions/pgq.get_consumer_info.sql
 \i functions/pgq.version.sql
 \i functions/pgq.get_batch_info.sql
+\i functions/pgq.stat_queues.sql
 
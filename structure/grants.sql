@@ -11,3 +11,4 @@ grant select on table pgq.subscription to public;
 grant select on table pgq.event_template to public;
 grant select on table pgq.retry_queue to public;
 
+grant select on table pgq.stat_queues to public;
@@ -2,6 +2,9 @@
 \i structure/tables.sql
 \i structure/func_internal.sql
 \i lowlevel_pl/insert_event.sql
+\i lowlevel_pl/get_batch_events.sql
+\i lowlevel_pl/wait_batch.sql
+\i lowlevel_pl/ticker.sql
 \i structure/func_public.sql
 \i structure/triggers_pl.sql
 \i structure/grants.sql
@@ -8,6 +8,7 @@
 --      pgq.tick                    - Per-queue snapshots (ticks)
 --      pgq.event_*                 - Data tables
 --      pgq.retry_queue             - Events to be retried later
+--      pgq.wal_position            - Position of WAL moved into queues
 --
 -- 
 -- Standard triggers store events in the pgq.event_* data tables
@@ -66,7 +67,10 @@ create table pgq.consumer (
 --      queue_ticker_max_count      - batch should not contain more events
 --      queue_ticker_max_lag        - events should not age more
 --      queue_ticker_idle_period    - how often to tick when no events happen
+--      queue_ticker_target_count   - adaptive ticking: batch size to aim for, 0 disables
 --      queue_per_tx_limit          - Max number of events single TX can insert
+--      queue_buffer_events         - collect events in memory and write them at commit
+--      queue_event_id_block        - how many event ids a backend reserves from sequence at once
 --      queue_data_pfx              - prefix for data table names
 --      queue_event_seq             - sequence for event id's
 --      queue_tick_seq              - sequence for tick id's
@@ -90,7 +94,10 @@ create table pgq.queue (
         queue_ticker_max_count      integer     not null default 500,
         queue_ticker_max_lag        interval    not null default '3 seconds',
         queue_ticker_idle_period    interval    not null default '1 minute',
+        queue_ticker_target_count   integer     not null default 0,
         queue_per_tx_limit          integer,
+        queue_buffer_events         boolean     not null default false,
+        queue_event_id_block        integer     not null default 1,
 
         queue_data_pfx              text        not null,
         queue_event_seq             text        not null,
@@ -113,6 +120,7 @@ create table pgq.queue (
 --      tick_time       - time when tick happened
 --      tick_snapshot   - transaction state
 --      tick_event_seq  - last value for event seq
+--      tick_event_rate - moving average of events/sec, set by pgq.ticker()
 -- ----------------------------------------------------------------------
 create table pgq.tick (
         tick_queue                  int4            not null,
@@ -120,6 +128,7 @@ create table pgq.tick (
         tick_time                   timestamptz     not null default now(),
         tick_snapshot               txid_snapshot   not null default txid_current_snapshot(),
         tick_event_seq              bigint          not null, -- may be NULL on upgraded dbs
+        tick_event_rate             float8,
 
         constraint tick_pkey primary key (tick_queue, tick_id),
         constraint tick_queue_fkey foreign key (tick_queue)
@@ -146,6 +155,10 @@ create sequence pgq.batch_id_seq;
 --      sub_last_tick   - last tick the consumer processed
 --      sub_batch       - shortcut for queue_id/consumer_id/tick_id
 --      sub_next_tick   - batch end pos
+--      sub_batch_start_id - with split batch, first ev_id of current part
+--      sub_batch_end_id   - with split batch, ev_id where next part starts
+--      sub_batch_time     - moving average of time between getting and finishing batch
+--      sub_batch_started  - wall clock time when current batch was given out
 -- ----------------------------------------------------------------------
 create table pgq.subscription (
         sub_id                          serial      not null,
@@ -155,6 +168,10 @@ create table pgq.subscription (
         sub_active                      timestamptz not null default now(),
         sub_batch                       bigint,
         sub_next_tick                   bigint,
+        sub_batch_start_id              bigint,
+        sub_batch_end_id                bigint,
+        sub_batch_time                  interval,
+        sub_batch_started               timestamptz,
 
         constraint subscription_pkey primary key (sub_queue, sub_consumer),
         constraint subscription_batch_idx unique (sub_batch),
@@ -223,3 +240,22 @@ alter table pgq.retry_queue alter column ev_owner set not null;
 alter table pgq.retry_queue alter column ev_txid drop not null;
 create index rq_retry_idx on pgq.retry_queue (ev_retry_after);
 
+-- ----------------------------------------------------------------------
+-- Table: pgq.wal_position
+--
+--      Last WAL position moved into queue by pgq.insert_wal_events().
+--      Updated in same transaction as events are inserted, the slot
+--      itself is advanced only on later call.
+--
+-- Columns:
+--      wal_slot_name       - logical replication slot
+--      wal_applied_lsn     - end of last transaction inserted into queue
+--      wal_applied_txid    - transaction that did the insert
+-- ----------------------------------------------------------------------
+create table pgq.wal_position (
+        wal_slot_name       text            not null,
+        wal_applied_lsn     pg_lsn          not null,
+        wal_applied_txid    bigint          not null,
+
+        constraint wal_position_pkey primary key (wal_slot_name)
+);
@@ -4,6 +4,7 @@
 -- Group: Trigger Functions
 
 \i lowlevel_pl/jsontriga.sql
+\i lowlevel_pl/bintriga.sql
 \i lowlevel_pl/logutriga.sql
 \i lowlevel_pl/sqltriga.sql
 
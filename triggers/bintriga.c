@@ -0,0 +1,336 @@
+/*
+ * bintriga.c - Smart trigger that logs MessagePack-encoded changes.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <postgres.h>
+#include <executor/spi.h>
+#include <commands/trigger.h>
+#include <catalog/pg_type.h>
+#include <lib/stringinfo.h>
+#include <utils/rel.h>
+#include <utils/timestamp.h>
+#include <utils/datetime.h>
+#if PG_VERSION_NUM >= 90300
+#include <access/htup_details.h>
+#endif
+
+#include "common.h"
+#include "stringutil.h"
+
+PG_FUNCTION_INFO_V1(pgq_bintriga);
+Datum pgq_bintriga(PG_FUNCTION_ARGS);
+
+#ifndef PG_INT32_MIN
+#define PG_INT32_MIN	(-0x7FFFFFFF-1)
+#endif
+
+/* microseconds between 1970-01-01 and 2000-01-01 */
+#define UNIX_EPOCH_OFFSET ((uint64)(POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY)
+
+/*
+ * MessagePack writers, multi-byte values are big-endian.
+ */
+
+static void mp_be(StringInfo buf, uint8 tag, uint64 val, int len)
+{
+	char tmp[9];
+	int i;
+
+	tmp[0] = tag;
+	for (i = len; i > 0; i--) {
+		tmp[i] = val & 0xFF;
+		val >>= 8;
+	}
+	appendBinaryStringInfo(buf, tmp, len + 1);
+}
+
+static void mp_uint(StringInfo buf, uint64 val)
+{
+	if (val < 128)
+		appendStringInfoCharMacro(buf, (char)val);
+	else if (val <= 0xFF)
+		mp_be(buf, 0xcc, val, 1);
+	else if (val <= 0xFFFF)
+		mp_be(buf, 0xcd, val, 2);
+	else if (val <= 0xFFFFFFFF)
+		mp_be(buf, 0xce, val, 4);
+	else
+		mp_be(buf, 0xcf, val, 8);
+}
+
+static void mp_int(StringInfo buf, int64 val)
+{
+	if (val >= 0)
+		mp_uint(buf, val);
+	else if (val >= -32)
+		appendStringInfoCharMacro(buf, (char)val);
+	else if (val >= -128)
+		mp_be(buf, 0xd0, (uint64)val, 1);
+	else if (val >= -32768)
+		mp_be(buf, 0xd1, (uint64)val, 2);
+	else if (val >= PG_INT32_MIN)
+		mp_be(buf, 0xd2, (uint64)val, 4);
+	else
+		mp_be(buf, 0xd3, (uint64)val, 8);
+}
+
+static void mp_float4(StringInfo buf, float4 val)
+{
+	union { float4 f; uint32 i; } u;
+
+	u.f = val;
+	mp_be(buf, 0xca, u.i, 4);
+}
+
+static void mp_float8(StringInfo buf, float8 val)
+{
+	union { float8 f; uint64 i; } u;
+
+	u.f = val;
+	mp_be(buf, 0xcb, u.i, 8);
+}
+
+static void mp_str(StringInfo buf, const char *str, int len)
+{
+	if (len < 32)
+		appendStringInfoCharMacro(buf, (char)(0xa0 | len));
+	else if (len <= 0xFF)
+		mp_be(buf, 0xd9, len, 1);
+	else if (len <= 0xFFFF)
+		mp_be(buf, 0xda, len, 2);
+	else
+		mp_be(buf, 0xdb, len, 4);
+	appendBinaryStringInfo(buf, str, len);
+}
+
+static void mp_bin(StringInfo buf, const char *data, int len)
+{
+	if (len <= 0xFF)
+		mp_be(buf, 0xc4, len, 1);
+	else if (len <= 0xFFFF)
+		mp_be(buf, 0xc5, len, 2);
+	else
+		mp_be(buf, 0xc6, len, 4);
+	appendBinaryStringInfo(buf, data, len);
+}
+
+static void mp_map(StringInfo buf, int count)
+{
+	if (count < 16)
+		appendStringInfoCharMacro(buf, (char)(0x80 | count));
+	else if (count <= 0xFFFF)
+		mp_be(buf, 0xde, count, 2);
+	else
+		mp_be(buf, 0xdf, count, 4);
+}
+
+/*
+ * Timestamps as microseconds since Unix epoch,
+ * infinite values as min/max int64.
+ */
+static void mp_timestamp(StringInfo buf, Timestamp ts)
+{
+	if (TIMESTAMP_NOT_FINITE(ts))
+		mp_int(buf, ts);
+	else if (ts >= 0)
+		mp_uint(buf, (uint64)ts + UNIX_EPOCH_OFFSET);
+	else
+		mp_int(buf, ts + (int64)UNIX_EPOCH_OFFSET);
+}
+
+static void mp_value(StringInfo buf, struct PgqColumnInfo *col, HeapTuple row, TupleDesc tupdesc)
+{
+	Datum val;
+	bool isnull;
+	bytea *bin;
+	char *str;
+
+	val = heap_getattr(row, col->attno + 1, tupdesc, &isnull);
+	if (isnull) {
+		appendStringInfoCharMacro(buf, (char)0xc0);
+		return;
+	}
+
+	switch (col->typid) {
+	case BOOLOID:
+		appendStringInfoCharMacro(buf, DatumGetBool(val) ? (char)0xc3 : (char)0xc2);
+		break;
+	case INT2OID:
+		mp_int(buf, DatumGetInt16(val));
+		break;
+	case INT4OID:
+		mp_int(buf, DatumGetInt32(val));
+		break;
+	case INT8OID:
+		mp_int(buf, DatumGetInt64(val));
+		break;
+	case FLOAT4OID:
+		mp_float4(buf, DatumGetFloat4(val));
+		break;
+	case FLOAT8OID:
+		mp_float8(buf, DatumGetFloat8(val));
+		break;
+	case TIMESTAMPOID:
+		mp_timestamp(buf, DatumGetTimestamp(val));
+		break;
+	case TIMESTAMPTZOID:
+		mp_timestamp(buf, DatumGetTimestampTz(val));
+		break;
+	case BYTEAOID:
+		bin = DatumGetByteaPP(val);
+		mp_bin(buf, VARDATA_ANY(bin), VARSIZE_ANY_EXHDR(bin));
+		if ((Pointer)bin != DatumGetPointer(val))
+			pfree(bin);
+		break;
+	default:
+		str = pgq_col_value(col, row, tupdesc);
+		mp_str(buf, str, strlen(str));
+		pfree(str);
+		break;
+	}
+}
+
+/*
+ * Convert row to base64-encoded MessagePack map.
+ */
+void pgq_msgpack_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
+{
+	TupleDesc tupdesc = ev->tgdata->tg_relation->rd_att;
+	struct PgqColumnInfo *col;
+	StringInfoData bin;
+	const char *name;
+	int i, count = 0;
+
+	initStringInfo(&bin);
+
+	if (ev->op_type == 'R') {
+		mp_map(&bin, 0);
+		goto done;
+	}
+
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (!(col->flags & PGQ_COL_SKIP) && !pgq_delta_skip_col(ev, i, row))
+			count++;
+	}
+	mp_map(&bin, count);
+
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (col->flags & PGQ_COL_SKIP)
+			continue;
+		if (pgq_delta_skip_col(ev, i, row))
+			continue;
+
+		name = NameStr(TupleDescAttr(tupdesc, col->attno)->attname);
+		mp_str(&bin, name, strlen(name));
+		mp_value(&bin, col, row, tupdesc);
+	}
+
+done:
+	pgq_encode_base64(buf, (uint8 *)bin.data, bin.len);
+	pfree(bin.data);
+}
+
+/*
+ * Create event for one row.  If batch is given, event
+ * is added there, otherwise inserted immediately.
+ *
+ * Returns true if operation should be skipped.
+ */
+static bool bintriga_event(TriggerData *tg, HeapTuple row, struct PgqEventBatch *batch)
+{
+	struct PgqTriggerEvent ev;
+
+	pgq_prepare_event(&ev, tg, true, pgq_msgpack_row);
+	ev.batch = batch;
+
+	appendStringInfoString(ev.field[EV_EXTRA1], ev.info->table_name);
+	appendStringInfoChar(ev.field[EV_TYPE], ev.op_type);
+	if (ev.op_type != 'R') {
+		appendStringInfoChar(ev.field[EV_TYPE], ':');
+		appendStringInfoString(ev.field[EV_TYPE], ev.pkey_list);
+	}
+
+	if (pgq_is_interesting_change(&ev, tg)) {
+		/*
+		 * create type, data
+		 */
+		pgq_msgpack_row(&ev, row, ev.field[EV_DATA]);
+
+		/*
+		 * Construct the parameter array and insert the log row.
+		 */
+		pgq_insert_tg_event(&ev);
+	}
+
+	return ev.tgargs->skip;
+}
+
+/*
+ * PgQ log trigger, takes 1 argument:
+ * 1. queue name to be inserted to.
+ *
+ * Queue events will be in format:
+ *    ev_type   - operation type, I/U/D/R ':' pkey columns
+ *    ev_data   - base64 of MessagePack map of column values
+ *    ev_extra1 - table name
+ *    ev_extra2 - optional backup of old row, same encoding
+ */
+Datum pgq_bintriga(PG_FUNCTION_ARGS)
+{
+	TriggerData *tg;
+	HeapTuple row;
+	bool skip = false;
+
+	/*
+	 * Get the trigger call context
+	 */
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "pgq.bintriga not called as trigger");
+
+	tg = (TriggerData *)(fcinfo->context);
+	if (TRIGGER_FIRED_BY_UPDATE(tg->tg_event))
+		row = tg->tg_newtuple;
+	else
+		row = tg->tg_trigtuple;
+
+	if (pgq_is_logging_disabled())
+		goto skip_it;
+
+	/*
+	 * Connect to the SPI manager
+	 */
+	if (SPI_connect() < 0)
+		elog(ERROR, "bintriga: SPI_connect() failed");
+
+	if (pgq_is_transition_trigger(tg))
+		pgq_transition_events(tg, bintriga_event);
+	else
+		skip = bintriga_event(tg, row, NULL);
+
+	if (SPI_finish() < 0)
+		elog(ERROR, "SPI_finish failed");
+
+	/*
+	 * After trigger ignores result,
+	 * before trigger skips event if NULL.
+	 */
+skip_it:
+	if (TRIGGER_FIRED_AFTER(tg->tg_event) || skip)
+		return PointerGetDatum(NULL);
+	else
+		return PointerGetDatum(row);
+}
@@ -23,15 +23,27 @@
 #include <catalog/pg_type.h>
 #include <catalog/pg_namespace.h>
 #include <catalog/pg_operator.h>
+#include <catalog/pg_proc.h>
 #include <executor/spi.h>
 #include <lib/stringinfo.h>
 #include <utils/memutils.h>
 #include <utils/inval.h>
+#include <utils/lsyscache.h>
 #include <utils/hsearch.h>
 #include <utils/syscache.h>
 #include <utils/typcache.h>
+#include <utils/datum.h>
 #include <utils/builtins.h>
 #include <utils/rel.h>
+#include <utils/array.h>
+#include <utils/acl.h>
+#include <utils/guc.h>
+#include <miscadmin.h>
+
+#if PG_VERSION_NUM >= 100000
+#include <executor/executor.h>
+#include <utils/tuplestore.h>
+#endif
 
 #if PG_VERSION_NUM >= 90300
 #include <access/htup_details.h>
@@ -51,9 +63,37 @@ PG_MODULE_MAGIC;
 /* memcmp is ok on NameData fields */
 #define is_magic_field(s) (memcmp(s, "_pgq_ev_", 8) == 0)
 
+void _PG_init(void);
+
 static void make_query(struct PgqTriggerEvent *ev, int fld, const char *arg);
 static void override_fields(struct PgqTriggerEvent *ev);
 
+/*
+ * Call pgq_lowlevel functions directly, instead of
+ * going through pgq.insert_event() wrappers.
+ */
+static bool direct_insert_enabled = false;
+
+struct DirectInsert {
+	const char *wrapper;	/* SQL function, determines permissions and user */
+	const char *symbol;	/* C function in pgq_lowlevel */
+	Oid wrapper_oid;
+	PGFunction fn;
+};
+
+/* pgq.insert_event_raw() has most args */
+#define DIRECT_MAX_ARGS 11
+
+static struct DirectInsert direct_single = {
+	"pgq.insert_event(text,text,text,text,text,text,text)",
+	"pgq_insert_event_raw"
+};
+
+static struct DirectInsert direct_batch = {
+	"pgq.insert_event_batch(text,text[],text[],text[],text[],text[],text[])",
+	"pgq_insert_event_batch_raw"
+};
+
 /*
  * primary key info
  */
@@ -71,6 +111,109 @@ static void *pkey_plan;
 
 static void relcache_reset_cb(Datum arg, Oid relid);
 
+/*
+ * Call insert function in pgq_lowlevel, as owner
+ * of the SQL wrapper function.
+ */
+static Datum direct_insert_call(struct DirectInsert *di, int nargs, Datum *values, bool *nulls)
+{
+#if PG_VERSION_NUM >= 120000
+	LOCAL_FCINFO(fcinfo, DIRECT_MAX_ARGS);
+#else
+	FunctionCallInfoData fcinfo_data;
+	FunctionCallInfo fcinfo = &fcinfo_data;
+#endif
+	FmgrInfo flinfo;
+	HeapTuple tup = NULL;
+	Oid owner, save_userid;
+	int save_sec_context;
+	bool allowed;
+	Datum res;
+	int i;
+
+	Assert(nargs <= DIRECT_MAX_ARGS);
+
+	if (!di->fn)
+		di->fn = (PGFunction) load_external_function("$libdir/pgq_lowlevel", di->symbol, true, NULL);
+
+	/* function may have been re-created */
+	if (OidIsValid(di->wrapper_oid))
+		tup = SearchSysCache1(PROCOID, ObjectIdGetDatum(di->wrapper_oid));
+	if (!HeapTupleIsValid(tup)) {
+		di->wrapper_oid = DatumGetObjectId(DirectFunctionCall1(regprocedurein,
+								       CStringGetDatum(di->wrapper)));
+		tup = SearchSysCache1(PROCOID, ObjectIdGetDatum(di->wrapper_oid));
+		if (!HeapTupleIsValid(tup))
+			elog(ERROR, "cache lookup failed for function %u", di->wrapper_oid);
+	}
+	owner = ((Form_pg_proc) GETSTRUCT(tup))->proowner;
+	ReleaseSysCache(tup);
+
+	/* same check as calling the wrapper */
+#if PG_VERSION_NUM >= 160000
+	allowed = object_aclcheck(ProcedureRelationId, di->wrapper_oid, GetUserId(), ACL_EXECUTE) == ACLCHECK_OK;
+#else
+	allowed = pg_proc_aclcheck(di->wrapper_oid, GetUserId(), ACL_EXECUTE) == ACLCHECK_OK;
+#endif
+	if (!allowed)
+		elog(ERROR, "permission denied for function %s", di->wrapper);
+
+	MemSet(&flinfo, 0, sizeof(flinfo));
+	flinfo.fn_addr = di->fn;
+	flinfo.fn_oid = InvalidOid;
+	flinfo.fn_nargs = nargs;
+	flinfo.fn_strict = false;
+	flinfo.fn_mcxt = CurrentMemoryContext;
+
+	InitFunctionCallInfoData(*fcinfo, &flinfo, nargs, InvalidOid, NULL, NULL);
+	for (i = 0; i < nargs; i++) {
+#if PG_VERSION_NUM >= 120000
+		fcinfo->args[i].value = values[i];
+		fcinfo->args[i].isnull = nulls[i];
+#else
+		fcinfo->arg[i] = values[i];
+		fcinfo->argnull[i] = nulls[i];
+#endif
+	}
+
+	/* act like security definer, error cleanup restores user */
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(owner, save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	res = FunctionCallInvoke(fcinfo);
+	if (fcinfo->isnull)
+		elog(ERROR, "%s returned NULL", di->symbol);
+
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	return res;
+}
+
+static void direct_simple_insert(const char *queue_name, Datum ev_type, Datum ev_data,
+				 Datum ev_extra1, Datum ev_extra2, Datum ev_extra3, Datum ev_extra4)
+{
+	Datum values[11];
+	bool nulls[11];
+	int i;
+
+	MemSet(values, 0, sizeof(values));
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = DirectFunctionCall1(textin, CStringGetDatum(queue_name));
+	/* ev_id, ev_time, ev_owner, ev_retry are filled by insert_event_raw */
+	for (i = 1; i < 5; i++)
+		nulls[i] = true;
+	values[5] = ev_type;
+	values[6] = ev_data;
+	values[7] = ev_extra1;
+	values[8] = ev_extra2;
+	values[9] = ev_extra3;
+	values[10] = ev_extra4;
+	for (i = 5; i < 11; i++)
+		nulls[i] = values[i] == (Datum)0;
+
+	direct_insert_call(&direct_single, 11, values, nulls);
+}
+
 /*
  * helper for queue insertion.
  *
@@ -84,6 +227,12 @@ void pgq_simple_insert(const char *queue_name, Datum ev_type, Datum ev_data,
 	static void *plan = NULL;
 	int res;
 
+	if (direct_insert_enabled) {
+		direct_simple_insert(queue_name, ev_type, ev_data,
+				     ev_extra1, ev_extra2, ev_extra3, ev_extra4);
+		return;
+	}
+
 	if (!plan) {
 		const char *sql;
 		Oid   types[7] = { TEXTOID, TEXTOID, TEXTOID, TEXTOID, TEXTOID, TEXTOID, TEXTOID };
@@ -158,6 +307,74 @@ static void fill_magic_columns(PgqTriggerEvent *ev)
 	}
 }
 
+/*
+ * Max events collected from statement trigger
+ * before inserting them.
+ */
+#define PGQ_BATCH_FLUSH 1000
+
+static void batch_add_event(struct PgqEventBatch *batch, PgqTriggerEvent *ev)
+{
+	int i;
+
+	for (i = 0; i < EV_WHEN; i++) {
+		batch->field[i] = accumArrayResult(batch->field[i],
+						   pgq_finish_varbuf(ev->field[i]),
+						   ev->field[i] == NULL,
+						   TEXTOID, batch->ctx);
+	}
+	batch->count++;
+}
+
+static void batch_flush(struct PgqEventBatch *batch)
+{
+	static void *plan = NULL;
+	Datum values[EV_WHEN + 1];
+	bool nulls[EV_WHEN + 1];
+	MemoryContext old_ctx;
+	int i, res;
+
+	if (batch->count == 0)
+		return;
+
+	/* arguments live in batch context, freed with it after insert */
+	old_ctx = MemoryContextSwitchTo(batch->ctx);
+	values[0] = DirectFunctionCall1(textin, CStringGetDatum(batch->queue_name));
+	nulls[0] = false;
+	for (i = 0; i < EV_WHEN; i++) {
+		values[i + 1] = makeArrayResult(batch->field[i], batch->ctx);
+		nulls[i + 1] = false;
+	}
+	MemoryContextSwitchTo(old_ctx);
+
+	if (direct_insert_enabled) {
+		direct_insert_call(&direct_batch, EV_WHEN + 1, values, nulls);
+		goto done;
+	}
+
+	if (!plan) {
+		const char *sql;
+		Oid   types[7] = { TEXTOID, TEXTARRAYOID, TEXTARRAYOID, TEXTARRAYOID,
+				   TEXTARRAYOID, TEXTARRAYOID, TEXTARRAYOID };
+
+		sql = "select pgq.insert_event_batch($1, $2, $3, $4, $5, $6, $7)";
+		plan = SPI_saveplan(SPI_prepare(sql, 7, types));
+		if (plan == NULL)
+			elog(ERROR, "pgq_triggers: SPI_prepare() failed");
+	}
+
+	res = SPI_execute_plan(plan, values, NULL, false, 0);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "call of pgq.insert_event_batch failed");
+	SPI_freetuptable(SPI_tuptable);
+
+done:
+	MemoryContextReset(batch->ctx);
+	for (i = 0; i < EV_WHEN; i++)
+		batch->field[i] = NULL;
+	batch->count = 0;
+}
+
 void pgq_insert_tg_event(PgqTriggerEvent *ev)
 {
 	if (ev->tgargs->custom_fields)
@@ -168,6 +385,11 @@ void pgq_insert_tg_event(PgqTriggerEvent *ev)
 	if (ev->skip_event)
 		return;
 
+	if (ev->batch) {
+		batch_add_event(ev->batch, ev);
+		return;
+	}
+
 	pgq_simple_insert(ev->queue_name,
 			  pgq_finish_varbuf(ev->field[EV_TYPE]),
 			  pgq_finish_varbuf(ev->field[EV_DATA]),
@@ -334,6 +556,57 @@ static void fill_tbl_info(Relation rel, struct PgqTableInfo *info)
 	info->tg_cache = NULL;
 }
 
+#if PG_VERSION_NUM >= 110000
+
+/*
+ * Fill table information from relcache, for callers
+ * that cannot run SPI queries (logical decoding).
+ * Pkey columns are in index order, same as pkey_sql.
+ */
+void pgq_fill_table_info(Relation rel, struct PgqTableInfo *info, MemoryContext ctx)
+{
+	StringInfo pkeys;
+	StringInfo jsbuf;
+	Relation pkrel;
+	const char *name;
+	int i, attno;
+
+	jsbuf = makeStringInfo();
+	name = find_table_name(rel, jsbuf);
+	appendStringInfoString(jsbuf, ",\"pkey\":[");
+
+	pkeys = makeStringInfo();
+	info->n_pkeys = 0;
+	info->pkey_attno = NULL;
+	info->table_name = MemoryContextStrdup(ctx, name);
+
+	/* loads rd_pkindex */
+	list_free(RelationGetIndexList(rel));
+	if (OidIsValid(rel->rd_pkindex)) {
+		pkrel = RelationIdGetRelation(rel->rd_pkindex);
+		info->n_pkeys = IndexRelationGetNumberOfKeyAttributes(pkrel);
+		info->pkey_attno = MemoryContextAlloc(ctx, info->n_pkeys * sizeof(int));
+		for (i = 0; i < info->n_pkeys; i++) {
+			attno = pkrel->rd_index->indkey.values[i];
+			name = NameStr(TupleDescAttr(rel->rd_att, attno - 1)->attname);
+			info->pkey_attno[i] = i + 1;
+			if (i > 0) {
+				appendStringInfoChar(pkeys, ',');
+				appendStringInfoChar(jsbuf, ',');
+			}
+			appendStringInfoString(pkeys, name);
+			pgq_encode_cstring(jsbuf, name, TBUF_QUOTE_JSON);
+		}
+		RelationClose(pkrel);
+	}
+	appendStringInfoChar(jsbuf, ']');
+	info->pkey_list = MemoryContextStrdup(ctx, pkeys->data);
+	info->json_info = MemoryContextStrdup(ctx, jsbuf->data);
+	info->tg_cache = NULL;
+}
+
+#endif
+
 static void clean_info(struct PgqTableInfo *info, bool found)
 {
 	struct PgqTriggerInfo *tg, *tmp = info->tg_cache;
@@ -352,6 +625,8 @@ static void clean_info(struct PgqTableInfo *info, bool found)
 			if (tg->query[i])
 				qb_free(tg->query[i]);
 		}
+		if (tg->col_ctx)
+			MemoryContextDelete(tg->col_ctx);
 		pfree(tg);
 		tg = tmp;
 	}
@@ -462,6 +737,8 @@ static void parse_newstyle_args(PgqTriggerEvent *ev, TriggerData *tg)
 			ev->tgargs->backup = true;
 		else if (strcmp(arg, "deny") == 0)
 			ev->tgargs->deny = true;
+		else if (strcmp(arg, "delta") == 0)
+			ev->tgargs->delta = true;
 		else if (strncmp(arg, "ev_extra4=", 10) == 0)
 			make_query(ev, EV_EXTRA4, arg + 10);
 		else if (strncmp(arg, "ev_extra3=", 10) == 0)
@@ -487,6 +764,8 @@ static void parse_newstyle_args(PgqTriggerEvent *ev, TriggerData *tg)
 			elog(ERROR, "Custom pkey_list does not make sense for truncate trigger");
 		if (ev->tgargs->backup)
 			elog(ERROR, "Backup does not make sense for truncate trigger");
+		if (ev->tgargs->delta)
+			elog(ERROR, "Delta does not make sense for truncate trigger");
 	}
 }
 
@@ -522,10 +801,185 @@ static void parse_oldstyle_args(PgqTriggerEvent *ev, TriggerData *tg)
 		elog(ERROR, "key column does not exist");
 }
 
+static const char *cache_name(MemoryContext ctx, const char *name, enum PgqEncode encoding)
+{
+	StringInfoData buf;
+	const char *res;
+
+	initStringInfo(&buf);
+	pgq_encode_cstring(&buf, name, encoding);
+	res = MemoryContextStrdup(ctx, buf.data);
+	pfree(buf.data);
+	return res;
+}
+
+/*
+ * Build column array for trigger, so row encoders
+ * do not need to look at ignore and pkey lists.
+ */
+void pgq_build_columns(PgqTriggerEvent *ev, MemoryContext parent)
+{
+	struct PgqTriggerInfo *tgargs = ev->tgargs;
+	TupleDesc tupdesc = ev->tgdata->tg_relation->rd_att;
+	struct PgqColumnInfo *columns, *col;
+	Form_pg_attribute attr;
+	TypeCacheEntry *type_cache;
+	const char *name;
+	Oid output_fn;
+	int i, n = 0;
+
+	if (!tgargs->col_ctx)
+		tgargs->col_ctx = AllocSetContextCreate(parent,
+							"pgq_triggers column info",
+#if (PG_VERSION_NUM >= 110000)
+							ALLOCSET_SMALL_SIZES
+#else
+							ALLOCSET_SMALL_MINSIZE,
+							ALLOCSET_SMALL_INITSIZE,
+							ALLOCSET_SMALL_MAXSIZE
+#endif
+							);
+	else
+		MemoryContextReset(tgargs->col_ctx);
+
+	columns = MemoryContextAllocZero(tgargs->col_ctx, (tupdesc->natts + 1) * sizeof(*columns));
+	for (i = 0; i < tupdesc->natts; i++) {
+		attr = TupleDescAttr(tupdesc, i);
+		if (attr->attisdropped)
+			continue;
+
+		col = &columns[n];
+		col->attno = i;
+		if (pgqtriga_skip_col(ev, i, n))
+			col->flags |= PGQ_COL_SKIP;
+		if (pgqtriga_is_pkey(ev, i, n))
+			col->flags |= PGQ_COL_PKEY;
+		col->typid = attr->atttypid;
+		col->collid = attr->attcollation;
+		col->typlen = attr->attlen;
+		col->typbyval = attr->attbyval;
+
+		name = NameStr(attr->attname);
+		col->name_ident = cache_name(tgargs->col_ctx, name, TBUF_QUOTE_IDENT);
+		col->name_urlenc = cache_name(tgargs->col_ctx, name, TBUF_QUOTE_URLENC);
+		col->name_json = cache_name(tgargs->col_ctx, name, TBUF_QUOTE_JSON);
+
+		getTypeOutputInfo(col->typid, &output_fn, &col->typisvarlena);
+		fmgr_info_cxt(output_fn, &col->output, tgargs->col_ctx);
+
+		/* arrays are compared as strings */
+		type_cache = lookup_type_cache(col->typid,
+					       TYPECACHE_EQ_OPR | TYPECACHE_EQ_OPR_FINFO);
+		if (OidIsValid(type_cache->eq_opr) && type_cache->eq_opr != ARRAY_EQ_OP)
+			fmgr_info_copy(&col->eq_fn, &type_cache->eq_opr_finfo, tgargs->col_ctx);
+		n++;
+	}
+
+	tgargs->columns = columns;
+	tgargs->n_columns = n;
+}
+
+/*
+ * Get column value as string, NULL if value is NULL.
+ */
+char *pgq_col_value(struct PgqColumnInfo *col, HeapTuple row, TupleDesc tupdesc)
+{
+	Datum val;
+	bool isnull;
+
+	val = heap_getattr(row, col->attno + 1, tupdesc, &isnull);
+	if (isnull)
+		return NULL;
+
+	/* avoid leaking detoasted copy inside output function */
+	if (col->typisvarlena)
+		val = PointerGetDatum(PG_DETOAST_DATUM(val));
+
+	return OutputFunctionCall(&col->output, val);
+}
+
+/*
+ * Compare old and new value of column.
+ */
+bool pgq_column_changed(struct PgqColumnInfo *col, HeapTuple old_row, HeapTuple new_row, TupleDesc tupdesc)
+{
+	Datum old_value;
+	Datum new_value;
+	bool old_isnull;
+	bool new_isnull;
+	char *old_strval;
+	char *new_strval;
+	bool changed;
+
+	old_value = heap_getattr(old_row, col->attno + 1, tupdesc, &old_isnull);
+	new_value = heap_getattr(new_row, col->attno + 1, tupdesc, &new_isnull);
+
+	/*
+	 * If old and new value are NULL, the column is unchanged
+	 */
+	if (old_isnull && new_isnull)
+		return false;
+	if (old_isnull || new_isnull)
+		return true;
+
+	/*
+	 * Identical bytes mean equal value.  For unmodified TOASTed
+	 * values UPDATE keeps the same on-disk toast pointer, so
+	 * this avoids fetching and decompressing them.
+	 */
+	if (datumIsEqual(old_value, new_value, col->typbyval, col->typlen))
+		return false;
+
+	/*
+	 * If we have an equal operator, use that to do binary
+	 * comparison. Else get the string representation of both
+	 * attributes and do string comparison.
+	 */
+	if (OidIsValid(col->eq_fn.fn_oid))
+		return !DatumGetBool(FunctionCall2Coll(&col->eq_fn, col->collid,
+						       old_value, new_value));
+
+	old_strval = pgq_col_value(col, old_row, tupdesc);
+	new_strval = pgq_col_value(col, new_row, tupdesc);
+	changed = strcmp(old_strval, new_strval) != 0;
+	pfree(old_strval);
+	pfree(new_strval);
+	return changed;
+}
+
+/*
+ * Delta mode: find changed columns once, for both
+ * backup and change detection.
+ */
+static void mark_changed_columns(PgqTriggerEvent *ev)
+{
+	TriggerData *tg = ev->tgdata;
+	TupleDesc tupdesc = tg->tg_relation->rd_att;
+	int i;
+
+	ev->changed = palloc0(ev->tgargs->n_columns * sizeof(bool));
+	for (i = 0; i < ev->tgargs->n_columns; i++)
+		ev->changed[i] = pgq_column_changed(&ev->tgargs->columns[i], tg->tg_trigtuple,
+						    tg->tg_newtuple, tupdesc);
+}
+
+/*
+ * In delta mode, UPDATE data has only pkey and changed
+ * columns, backup of old row only changed columns.
+ */
+bool pgq_delta_skip_col(PgqTriggerEvent *ev, int i, HeapTuple row)
+{
+	if (!ev->changed || ev->changed[i])
+		return false;
+	if (row == ev->tgdata->tg_trigtuple)
+		return true;
+	return (ev->tgargs->columns[i].flags & PGQ_COL_PKEY) == 0;
+}
+
 /*
  * parse trigger arguments.
  */
-void pgq_prepare_event(struct PgqTriggerEvent *ev, TriggerData *tg, bool newstyle, bool jsonbackup)
+void pgq_prepare_event(struct PgqTriggerEvent *ev, TriggerData *tg, bool newstyle, PgqRowEncodeFunc backup_enc)
 {
 	memset(ev, 0, sizeof(*ev));
 
@@ -588,6 +1042,9 @@ void pgq_prepare_event(struct PgqTriggerEvent *ev, TriggerData *tg, bool newstyl
 	}
 	ev->tgargs->finalized = true;
 
+	if (ev->op_type != 'R' && !ev->tgargs->columns)
+		pgq_build_columns(ev, tbl_cache_ctx);
+
 	/*
 	 * Check if BEFORE/AFTER makes sense.
 	 */
@@ -611,16 +1068,18 @@ void pgq_prepare_event(struct PgqTriggerEvent *ev, TriggerData *tg, bool newstyl
 	ev->field[EV_DATA] = pgq_init_varbuf();
 	ev->field[EV_EXTRA1] = pgq_init_varbuf();
 
+	/*
+	 * Delta mode needs changed columns before backup.
+	 */
+	if (ev->tgargs->delta && ev->op_type == 'U')
+		mark_changed_columns(ev);
+
 	/*
 	 * Do the backup, if requested.
 	 */
 	if (ev->tgargs->backup && ev->op_type == 'U') {
 		ev->field[EV_EXTRA2] = pgq_init_varbuf();
-		if (jsonbackup) {
-			pgq_jsonenc_row(ev, tg->tg_trigtuple, ev->field[EV_EXTRA2]);
-		} else {
-			pgq_urlenc_row(ev, tg->tg_trigtuple, ev->field[EV_EXTRA2]);
-		}
+		backup_enc(ev, tg->tg_trigtuple, ev->field[EV_EXTRA2]);
 	}
 }
 
@@ -792,8 +1251,13 @@ static void make_query(struct PgqTriggerEvent *ev, int fld, const char *arg)
 static void override_fields(struct PgqTriggerEvent *ev)
 {
 	TriggerData *tg = ev->tgdata;
-	int res, i;
+	int i;
 	char *val;
+	Datum res;
+	bool isnull;
+	Oid restype;
+	Oid output_fn;
+	bool typisvarlena;
 
 	/* no overrides */
 	if (!ev->tgargs)
@@ -802,37 +1266,31 @@ static void override_fields(struct PgqTriggerEvent *ev)
 	for (i = 0; i < EV_NFIELDS; i++) {
 		if (!ev->tgargs->query[i])
 			continue;
-		res = qb_execute(ev->tgargs->query[i], tg);
-		if (res != SPI_OK_SELECT)
-			elog(ERROR, "Override query failed");
-		if (SPI_processed != 1)
-			elog(ERROR, "Expect 1 row from override query, got %d", (int)SPI_processed);
+		res = qb_eval(ev->tgargs->query[i], tg, &isnull, &restype);
 
 		/* special handling for EV_WHEN */
 		if (i == EV_WHEN) {
-			bool isnull;
-			Oid oid = SPI_gettypeid(SPI_tuptable->tupdesc, 1);
-			Datum when_res;
-			if (oid != BOOLOID)
-				elog(ERROR, "when= query result must be boolean, got=%u", oid);
-			when_res = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+			if (restype != BOOLOID)
+				elog(ERROR, "when= query result must be boolean, got=%u", restype);
 			if (isnull)
 				elog(ERROR, "when= should not be NULL");
-			if (DatumGetBool(when_res) == 0)
+			if (DatumGetBool(res) == 0)
 				ev->skip_event = true;
 			continue;
 		}
 
 		/* normal field */
-		val = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
 		if (ev->field[i]) {
 			pfree(ev->field[i]->data);
 			pfree(ev->field[i]);
 			ev->field[i] = NULL;
 		}
-		if (val) {
+		if (!isnull) {
+			getTypeOutputInfo(restype, &output_fn, &typisvarlena);
+			val = OidOutputFunctionCall(output_fn, res);
 			ev->field[i] = pgq_init_varbuf();
 			appendStringInfoString(ev->field[i], val);
+			pfree(val);
 		}
 	}
 }
@@ -845,85 +1303,34 @@ int pgq_is_interesting_change(PgqTriggerEvent *ev, TriggerData *tg)
 	HeapTuple old_row = tg->tg_trigtuple;
 	HeapTuple new_row = tg->tg_newtuple;
 	TupleDesc tupdesc = tg->tg_relation->rd_att;
-	Datum old_value;
-	Datum new_value;
-	bool old_isnull;
-	bool new_isnull;
+	struct PgqColumnInfo *col;
 	bool is_pk;
+	bool changed;
 
-	int i, attkind_idx = -1;
+	int i;
 	int ignore_count = 0;
 
 	/* only UPDATE may need to be ignored */
 	if (!TRIGGER_FIRED_BY_UPDATE(tg->tg_event))
 		return 1;
 
-	for (i = 0; i < tupdesc->natts; i++) {
-		/*
-		 * Ignore dropped columns
-		 */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
-			continue;
-		attkind_idx++;
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
 
-		is_pk = pgqtriga_is_pkey(ev, i, attkind_idx);
-		if (!is_pk && ev->tgargs->ignore_list == NULL)
+		is_pk = (col->flags & PGQ_COL_PKEY) != 0;
+		if (ev->changed)
+			changed = ev->changed[i];
+		else if (!is_pk && ev->tgargs->ignore_list == NULL)
 			continue;
-
-		old_value = SPI_getbinval(old_row, tupdesc, i + 1, &old_isnull);
-		new_value = SPI_getbinval(new_row, tupdesc, i + 1, &new_isnull);
-
-		/*
-		 * If old and new value are NULL, the column is unchanged
-		 */
-		if (old_isnull && new_isnull)
+		else
+			changed = pgq_column_changed(col, old_row, new_row, tupdesc);
+		if (!changed)
 			continue;
 
-		/*
-		 * If both are NOT NULL, we need to compare the values and skip
-		 * setting the column if equal
-		 */
-		if (!old_isnull && !new_isnull) {
-			Oid opr_oid;
-			FmgrInfo *opr_finfo_p;
-
-			/*
-			 * Lookup the equal operators function call info using the
-			 * typecache if available
-			 */
-			TypeCacheEntry *type_cache;
-
-			type_cache = lookup_type_cache(SPI_gettypeid(tupdesc, i + 1),
-						       TYPECACHE_EQ_OPR | TYPECACHE_EQ_OPR_FINFO);
-			opr_oid = type_cache->eq_opr;
-			if (opr_oid == ARRAY_EQ_OP)
-				opr_oid = InvalidOid;
-			else
-				opr_finfo_p = &(type_cache->eq_opr_finfo);
-
-			/*
-			 * If we have an equal operator, use that to do binary
-			 * comparison. Else get the string representation of both
-			 * attributes and do string comparison.
-			 */
-			if (OidIsValid(opr_oid)) {
-				if (DatumGetBool(FunctionCall2Coll(opr_finfo_p,
-								   TupleDescAttr(tupdesc, i)->attcollation,
-								   old_value, new_value)))
-					continue;
-			} else {
-				char *old_strval = SPI_getvalue(old_row, tupdesc, i + 1);
-				char *new_strval = SPI_getvalue(new_row, tupdesc, i + 1);
-
-				if (strcmp(old_strval, new_strval) == 0)
-					continue;
-			}
-		}
-
 		if (is_pk)
 			elog(ERROR, "primary key update not allowed");
 
-		if (pgqtriga_skip_col(ev, i, attkind_idx)) {
+		if (col->flags & PGQ_COL_SKIP) {
 			/* this change should be ignored */
 			ignore_count++;
 			continue;
@@ -941,3 +1348,171 @@ int pgq_is_interesting_change(PgqTriggerEvent *ev, TriggerData *tg)
 	return 1;
 }
 
+/*
+ * Statement triggers with transition tables.
+ */
+
+bool pgq_is_transition_trigger(TriggerData *tg)
+{
+	return TRIGGER_FIRED_FOR_STATEMENT(tg->tg_event)
+		&& !TRIGGER_FIRED_BY_TRUNCATE(tg->tg_event);
+}
+
+#if PG_VERSION_NUM >= 100000
+
+static TupleTableSlot *open_transition_table(Tuplestorestate *store, TupleDesc desc)
+{
+	int ptr;
+
+	/* other triggers may read same tuplestore, use own read pointer */
+	ptr = tuplestore_alloc_read_pointer(store, EXEC_FLAG_REWIND);
+	tuplestore_select_read_pointer(store, ptr);
+	tuplestore_rescan(store);
+
+#if PG_VERSION_NUM >= 120000
+	return MakeSingleTupleTableSlot(desc, &TTSOpsMinimalTuple);
+#else
+	return MakeSingleTupleTableSlot(desc);
+#endif
+}
+
+static HeapTuple next_transition_row(Tuplestorestate *store, TupleTableSlot *slot)
+{
+	if (!tuplestore_gettupleslot(store, true, false, slot))
+		return NULL;
+#if PG_VERSION_NUM >= 120000
+	return ExecCopySlotHeapTuple(slot);
+#else
+	return ExecCopySlotTuple(slot);
+#endif
+}
+
+/*
+ * Call row_event for each row in transition tables,
+ * as if it was fired as row trigger.  Events are
+ * inserted in batches.
+ *
+ * For UPDATE, rows in OLD TABLE and NEW TABLE
+ * are in same order.
+ */
+void pgq_transition_events(TriggerData *tg, PgqRowEventFunc row_event)
+{
+	TupleDesc desc = tg->tg_relation->rd_att;
+	Tuplestorestate *main_store, *new_store = NULL;
+	TupleTableSlot *main_slot, *new_slot = NULL;
+	struct PgqEventBatch batch;
+	MemoryContext row_ctx, old_ctx;
+	TriggerData row_tg;
+	HeapTuple row, new_row;
+
+	if (tg->tg_trigger->tgnargs < 1)
+		elog(ERROR, "pgq trigger must have destination queue as argument");
+
+	if (TRIGGER_FIRED_BY_INSERT(tg->tg_event)) {
+		main_store = tg->tg_newtable;
+	} else if (TRIGGER_FIRED_BY_UPDATE(tg->tg_event)) {
+		main_store = tg->tg_oldtable;
+		new_store = tg->tg_newtable;
+		if (!new_store)
+			main_store = NULL;
+	} else if (TRIGGER_FIRED_BY_DELETE(tg->tg_event)) {
+		main_store = tg->tg_oldtable;
+	} else {
+		elog(ERROR, "unknown event for pgq trigger");
+	}
+	if (!main_store)
+		elog(ERROR, "pgq statement trigger needs REFERENCING OLD TABLE / NEW TABLE");
+
+	/* pretend to be row trigger */
+	memcpy(&row_tg, tg, sizeof(row_tg));
+	row_tg.tg_event = tg->tg_event | TRIGGER_EVENT_ROW;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.queue_name = tg->tg_trigger->tgargs[0];
+	batch.ctx = AllocSetContextCreate(CurrentMemoryContext,
+					  "pgq_triggers event batch",
+#if (PG_VERSION_NUM >= 110000)
+					  ALLOCSET_DEFAULT_SIZES
+#else
+					  ALLOCSET_DEFAULT_MINSIZE,
+					  ALLOCSET_DEFAULT_INITSIZE,
+					  ALLOCSET_DEFAULT_MAXSIZE
+#endif
+					  );
+	row_ctx = AllocSetContextCreate(CurrentMemoryContext,
+					"pgq_triggers row event",
+#if (PG_VERSION_NUM >= 110000)
+					ALLOCSET_DEFAULT_SIZES
+#else
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE
+#endif
+					);
+
+	main_slot = open_transition_table(main_store, desc);
+	if (new_store)
+		new_slot = open_transition_table(new_store, desc);
+
+	while (1) {
+		old_ctx = MemoryContextSwitchTo(row_ctx);
+
+		row = next_transition_row(main_store, main_slot);
+		if (!row) {
+			MemoryContextSwitchTo(old_ctx);
+			break;
+		}
+
+		row_tg.tg_trigtuple = row;
+		row_tg.tg_newtuple = NULL;
+		if (new_store) {
+			new_row = next_transition_row(new_store, new_slot);
+			if (!new_row)
+				elog(ERROR, "pgq trigger: transition tables do not match");
+			row_tg.tg_newtuple = new_row;
+			row = new_row;
+		}
+
+		row_event(&row_tg, row, &batch);
+
+		MemoryContextSwitchTo(old_ctx);
+		MemoryContextReset(row_ctx);
+
+		if (batch.count >= PGQ_BATCH_FLUSH)
+			batch_flush(&batch);
+	}
+	batch_flush(&batch);
+
+	ExecDropSingleTupleTableSlot(main_slot);
+	if (new_slot)
+		ExecDropSingleTupleTableSlot(new_slot);
+	MemoryContextDelete(row_ctx);
+	MemoryContextDelete(batch.ctx);
+}
+
+#else
+
+void pgq_transition_events(TriggerData *tg, PgqRowEventFunc row_event)
+{
+	elog(ERROR, "pgq statement trigger needs PostgreSQL 10+");
+}
+
+#endif
+
+/*
+ * Module init.
+ */
+void _PG_init(void)
+{
+	DefineCustomBoolVariable("pgq.trigger_direct_insert",
+				 "Triggers call pgq_lowlevel insert functions directly.",
+				 "Skips pgq.insert_event() and pgq.insert_event_batch() SQL wrappers.",
+				 &direct_insert_enabled,
+				 false,
+				 PGC_USERSET,
+				 0,
+#if PG_VERSION_NUM >= 90100
+				 NULL,
+#endif
+				 NULL, NULL);
+}
@@ -45,9 +45,46 @@ struct PgqTriggerEvent {
 
 	/* if 'when=' query fails */
 	bool skip_event;
+
+	/* collect event here instead of inserting */
+	struct PgqEventBatch *batch;
+
+	/* delta mode: changed flag per column */
+	bool *changed;
 };
 typedef struct PgqTriggerEvent PgqTriggerEvent;
 
+/*
+ * Per-column cached info, built once per trigger.
+ * Dropped columns are left out, so array index
+ * matches attkind index.
+ */
+#define PGQ_COL_SKIP	1	/* column is ignored */
+#define PGQ_COL_PKEY	2	/* column is part of pkey */
+
+struct PgqColumnInfo {
+	int attno;		/* position in tupdesc, 0-based */
+	int flags;		/* PGQ_COL_* bits */
+	Oid typid;
+	Oid collid;
+	int16 typlen;
+	bool typbyval;
+	bool typisvarlena;
+	const char *name_ident;	/* quoted identifier */
+	const char *name_urlenc;	/* urlencoded name */
+	const char *name_json;	/* JSON string */
+	FmgrInfo output;	/* type output function */
+	FmgrInfo eq_fn;		/* equality function, if usable */
+
+	/* jsontriga value encoding, resolved on first use */
+	int json_kind;
+	int json_elem_kind;	/* element encoding for arrays */
+	Oid elemtype;
+	int16 elmlen;
+	bool elmbyval;
+	char elmalign;
+};
+
 /*
  * Per trigger cached info, stored under table cache,
  * so that invalidate can drop it.
@@ -61,11 +98,16 @@ struct PgqTriggerInfo {
 	bool backup;
 	bool custom_fields;
 	bool deny;
+	bool delta;
 
 	const char *ignore_list;
 	const char *pkey_list;
 
 	struct QueryBuilder *query[EV_NFIELDS];
+
+	MemoryContext col_ctx;
+	int n_columns;
+	struct PgqColumnInfo *columns;
 };
 
 /*
@@ -85,13 +127,41 @@ struct PgqTableInfo {
 	struct PgqTriggerInfo *tg_cache;
 };
 
+/*
+ * Events collected from statement trigger,
+ * inserted with pgq.insert_event_batch().
+ */
+struct PgqEventBatch {
+	const char *queue_name;
+	MemoryContext ctx;
+	int count;
+	struct ArrayBuildState *field[EV_WHEN];
+};
+
+/*
+ * Row encoder, used for ev_data and backup.
+ */
+typedef void (*PgqRowEncodeFunc)(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf);
+
+/*
+ * Per-row callback for statement triggers.
+ */
+typedef bool (*PgqRowEventFunc)(TriggerData *tg, HeapTuple row, struct PgqEventBatch *batch);
+
 /* common.c */
-void pgq_prepare_event(struct PgqTriggerEvent *ev, TriggerData *tg, bool newstyle, bool jsonbackup);
+void pgq_prepare_event(struct PgqTriggerEvent *ev, TriggerData *tg, bool newstyle, PgqRowEncodeFunc backup_enc);
 void pgq_simple_insert(const char *queue_name, Datum ev_type, Datum ev_data,
 		       Datum ev_extra1, Datum ev_extra2, Datum ev_extra3, Datum ev_extra4);
 bool pgqtriga_skip_col(PgqTriggerEvent *ev, int i, int attkind_idx);
 bool pgqtriga_is_pkey(PgqTriggerEvent *ev, int i, int attkind_idx);
+char *pgq_col_value(struct PgqColumnInfo *col, HeapTuple row, TupleDesc tupdesc);
+bool pgq_delta_skip_col(PgqTriggerEvent *ev, int i, HeapTuple row);
+bool pgq_column_changed(struct PgqColumnInfo *col, HeapTuple old_row, HeapTuple new_row, TupleDesc tupdesc);
 void pgq_insert_tg_event(PgqTriggerEvent *ev);
+void pgq_build_columns(PgqTriggerEvent *ev, MemoryContext parent);
+void pgq_fill_table_info(Relation rel, struct PgqTableInfo *info, MemoryContext ctx);
+bool pgq_is_transition_trigger(TriggerData *tg);
+void pgq_transition_events(TriggerData *tg, PgqRowEventFunc row_event);
 
 bool pgq_is_logging_disabled(void);
 
@@ -103,6 +173,10 @@ void pgq_urlenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf);
 
 /* jsontriga.c */
 void pgq_jsonenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf);
+void pgq_jsonenc_type(PgqTriggerEvent *ev, StringInfo ev_type);
+
+/* bintriga.c */
+void pgq_msgpack_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf);
 
 int pgq_is_interesting_change(PgqTriggerEvent *ev, TriggerData *tg);
 
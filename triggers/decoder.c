@@ -0,0 +1,415 @@
+/*
+ * decoder.c - Logical decoding output plugin that produces PgQ events.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Slot is created with plugin name 'pgq_triggers':
+ *
+ *   select pg_create_logical_replication_slot('myslot', 'pgq_triggers');
+ *
+ * Each row change is written as single line:
+ *
+ *   ev_type <TAB> ev_extra1 <TAB> ev_data
+ *
+ * with same encoding as jsontriga/logutriga/bintriga would use,
+ * followed by empty line at end of transaction.  pgq.insert_wal_events()
+ * moves the lines into queue.
+ */
+
+#include <postgres.h>
+#include <commands/trigger.h>
+#include <lib/stringinfo.h>
+#include <nodes/parsenodes.h>
+#include <utils/memutils.h>
+#include <utils/inval.h>
+#include <utils/hsearch.h>
+#include <utils/rel.h>
+
+#if PG_VERSION_NUM >= 110000
+#include <access/htup_details.h>
+#include <replication/logical.h>
+#include <replication/output_plugin.h>
+#include <replication/reorderbuffer.h>
+#endif
+
+#include "common.h"
+#include "stringutil.h"
+
+#if PG_VERSION_NUM >= 110000
+
+void _PG_output_plugin_init(OutputPluginCallbacks *cb);
+
+/* since 17 change keeps HeapTuple directly */
+#if PG_VERSION_NUM >= 170000
+#define change_tuple(t) (t)
+#else
+#define change_tuple(t) ((t) ? &(t)->tuple : NULL)
+#endif
+
+enum DecodeFormat {
+	FMT_JSON,		/* jsontriga */
+	FMT_URLENC,		/* logutriga */
+	FMT_MSGPACK,		/* bintriga */
+};
+
+/*
+ * Per-table info, same as triggers would use.
+ */
+struct DecodeRelInfo {
+	Oid reloid;		/* must be first, used by htab */
+	bool valid;
+	bool skip;		/* filtered out or internal table */
+	MemoryContext ctx;
+	struct PgqTableInfo info;
+	struct PgqTriggerInfo tgargs;
+};
+
+struct DecodeState {
+	enum DecodeFormat format;
+	const char *tables;	/* table list, NULL means all tables */
+	MemoryContext row_ctx;
+	MemoryContext rel_ctx;
+	HTAB *rel_map;
+};
+
+/* relcache callback cannot be unregistered, so it looks here */
+static HTAB *active_rel_map;
+
+static void decoder_relcache_cb(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS st;
+	struct DecodeRelInfo *entry;
+
+	if (!active_rel_map)
+		return;
+
+	if (relid == InvalidOid) {
+		hash_seq_init(&st, active_rel_map);
+		while ((entry = hash_seq_search(&st)) != NULL)
+			entry->valid = false;
+	} else {
+		entry = hash_search(active_rel_map, &relid, HASH_FIND, NULL);
+		if (entry)
+			entry->valid = false;
+	}
+}
+
+static void decoder_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is_init)
+{
+	static bool callback_init = false;
+	struct DecodeState *state;
+	HASHCTL hctl;
+	ListCell *lc;
+	DefElem *elem;
+	const char *val;
+
+	state = MemoryContextAllocZero(ctx->context, sizeof(*state));
+	state->format = FMT_JSON;
+
+	foreach(lc, ctx->output_plugin_options) {
+		elem = lfirst(lc);
+		val = elem->arg ? strVal(elem->arg) : NULL;
+
+		if (strcmp(elem->defname, "format") == 0) {
+			if (val == NULL || strcmp(val, "json") == 0)
+				state->format = FMT_JSON;
+			else if (strcmp(val, "urlenc") == 0)
+				state->format = FMT_URLENC;
+			else if (strcmp(val, "msgpack") == 0)
+				state->format = FMT_MSGPACK;
+			else
+				elog(ERROR, "pgq decoder: unknown format: %s", val);
+		} else if (strcmp(elem->defname, "tables") == 0) {
+			if (val)
+				state->tables = MemoryContextStrdup(ctx->context, val);
+		} else {
+			elog(ERROR, "pgq decoder: unknown option: %s", elem->defname);
+		}
+	}
+
+	state->row_ctx = AllocSetContextCreate(ctx->context,
+					       "pgq decoder row",
+					       ALLOCSET_DEFAULT_SIZES);
+	state->rel_ctx = AllocSetContextCreate(ctx->context,
+					       "pgq decoder table info",
+					       ALLOCSET_SMALL_SIZES);
+
+	MemSet(&hctl, 0, sizeof(hctl));
+	hctl.keysize = sizeof(Oid);
+	hctl.entrysize = sizeof(struct DecodeRelInfo);
+	hctl.hcxt = state->rel_ctx;
+	state->rel_map = hash_create("pgq decoder table cache", 128, &hctl,
+				     HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	active_rel_map = state->rel_map;
+
+	if (!callback_init) {
+		CacheRegisterRelcacheCallback(decoder_relcache_cb, (Datum)0);
+		callback_init = true;
+	}
+
+	ctx->output_plugin_private = state;
+	opt->output_type = OUTPUT_PLUGIN_TEXTUAL_OUTPUT;
+}
+
+static void decoder_shutdown(LogicalDecodingContext *ctx)
+{
+	/* memory goes away with decoding context */
+	active_rel_map = NULL;
+}
+
+/*
+ * Fake trigger call for row encoders.
+ */
+static void init_event(PgqTriggerEvent *ev, TriggerData *tg, struct DecodeRelInfo *entry,
+		       Relation rel, char op_type)
+{
+	memset(ev, 0, sizeof(*ev));
+	memset(tg, 0, sizeof(*tg));
+	tg->type = T_TriggerData;
+	tg->tg_relation = rel;
+
+	ev->tgdata = tg;
+	ev->info = &entry->info;
+	ev->tgargs = &entry->tgargs;
+	ev->table_name = entry->info.table_name;
+	ev->pkey_list = entry->info.pkey_list;
+	ev->op_type = op_type;
+	switch (op_type) {
+	case 'I': ev->op_type_str = "INSERT"; break;
+	case 'U': ev->op_type_str = "UPDATE"; break;
+	case 'D': ev->op_type_str = "DELETE"; break;
+	case 'R': ev->op_type_str = "TRUNCATE"; break;
+	}
+}
+
+static struct DecodeRelInfo *find_rel_info(struct DecodeState *state, Relation rel)
+{
+	struct DecodeRelInfo *entry;
+	struct PgqTriggerEvent ev;
+	TriggerData tg;
+	bool found;
+
+	entry = hash_search(state->rel_map, &rel->rd_id, HASH_ENTER, &found);
+	if (found && entry->valid)
+		return entry;
+
+	if (!found)
+		entry->ctx = AllocSetContextCreate(state->rel_ctx,
+						   "pgq decoder table",
+						   ALLOCSET_SMALL_SIZES);
+	else
+		MemoryContextReset(entry->ctx);
+	memset(&entry->tgargs, 0, sizeof(entry->tgargs));
+
+	pgq_fill_table_info(rel, &entry->info, entry->ctx);
+	entry->info.reloid = rel->rd_id;
+
+	/* never log changes to queue tables */
+	entry->skip = strncmp(entry->info.table_name, "pgq.", 4) == 0;
+	if (state->tables && !pgq_strlist_contains(state->tables, entry->info.table_name))
+		entry->skip = true;
+
+	if (!entry->skip) {
+		init_event(&ev, &tg, entry, rel, 'I');
+		pgq_build_columns(&ev, entry->ctx);
+	}
+
+	entry->valid = true;
+	return entry;
+}
+
+/*
+ * Unchanged TOASTed values are not in WAL.  Take them from
+ * old row if it has all columns (REPLICA IDENTITY FULL),
+ * otherwise leave the columns out of event.
+ */
+static HeapTuple fill_unchanged_toast(PgqTriggerEvent *ev, HeapTuple row, HeapTuple old_row)
+{
+	TupleDesc desc = ev->tgdata->tg_relation->rd_att;
+	struct PgqColumnInfo *col;
+	Datum *values = NULL;
+	bool *nulls = NULL;
+	bool *replace = NULL;
+	Datum val;
+	bool isnull;
+	int i;
+
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (col->typlen != -1 || (col->flags & PGQ_COL_SKIP))
+			continue;
+
+		val = heap_getattr(row, col->attno + 1, desc, &isnull);
+		if (isnull || !VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(val)))
+			continue;
+
+		if (old_row) {
+			if (!values) {
+				values = palloc0(desc->natts * sizeof(Datum));
+				nulls = palloc0(desc->natts * sizeof(bool));
+				replace = palloc0(desc->natts * sizeof(bool));
+			}
+			values[col->attno] = heap_getattr(old_row, col->attno + 1, desc, &nulls[col->attno]);
+			replace[col->attno] = true;
+		} else {
+			/* encoders skip unchanged non-pkey columns */
+			if (!ev->changed) {
+				ev->changed = palloc(ev->tgargs->n_columns * sizeof(bool));
+				memset(ev->changed, true, ev->tgargs->n_columns * sizeof(bool));
+			}
+			ev->changed[i] = false;
+		}
+	}
+
+	if (values)
+		row = heap_modify_tuple(row, desc, values, nulls, replace);
+	return row;
+}
+
+static void write_event(LogicalDecodingContext *ctx, struct DecodeState *state,
+			PgqTriggerEvent *ev, HeapTuple row)
+{
+	StringInfo out = ctx->out;
+
+	OutputPluginPrepareWrite(ctx, true);
+
+	if (state->format == FMT_JSON) {
+		pgq_jsonenc_type(ev, out);
+	} else {
+		appendStringInfoChar(out, ev->op_type);
+		if (ev->op_type != 'R') {
+			appendStringInfoChar(out, ':');
+			appendStringInfoString(out, ev->pkey_list);
+		}
+	}
+	appendStringInfoChar(out, '\t');
+	appendStringInfoString(out, ev->table_name);
+	appendStringInfoChar(out, '\t');
+
+	switch (state->format) {
+	case FMT_JSON:
+		pgq_jsonenc_row(ev, row, out);
+		break;
+	case FMT_URLENC:
+		pgq_urlenc_row(ev, row, out);
+		break;
+	case FMT_MSGPACK:
+		pgq_msgpack_row(ev, row, out);
+		break;
+	}
+
+	OutputPluginWrite(ctx, true);
+}
+
+static void decoder_begin(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+}
+
+static void decoder_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+			   Relation rel, ReorderBufferChange *change)
+{
+	struct DecodeState *state = ctx->output_plugin_private;
+	struct DecodeRelInfo *entry;
+	struct PgqTriggerEvent ev;
+	TriggerData tg;
+	HeapTuple row, old_row;
+	bool full_identity;
+	MemoryContext old_ctx;
+
+	old_ctx = MemoryContextSwitchTo(state->row_ctx);
+
+	entry = find_rel_info(state, rel);
+	if (entry->skip)
+		goto done;
+
+	full_identity = rel->rd_rel->relreplident == REPLICA_IDENTITY_FULL;
+	old_row = change_tuple(change->data.tp.oldtuple);
+
+	switch (change->action) {
+	case REORDER_BUFFER_CHANGE_INSERT:
+		init_event(&ev, &tg, entry, rel, 'I');
+		row = change_tuple(change->data.tp.newtuple);
+		break;
+	case REORDER_BUFFER_CHANGE_UPDATE:
+		init_event(&ev, &tg, entry, rel, 'U');
+		row = change_tuple(change->data.tp.newtuple);
+		if (row)
+			row = fill_unchanged_toast(&ev, row, full_identity ? old_row : NULL);
+		break;
+	case REORDER_BUFFER_CHANGE_DELETE:
+		init_event(&ev, &tg, entry, rel, 'D');
+		row = old_row;
+		/* only key columns are logged, send pkey like delta mode */
+		if (row && !full_identity)
+			ev.changed = palloc0(entry->tgargs.n_columns * sizeof(bool));
+		break;
+	default:
+		goto done;
+	}
+
+	/* triggers refuse Update/Delete on table without pkey */
+	if (!row || (ev.op_type != 'I' && entry->info.n_pkeys == 0))
+		goto done;
+
+	write_event(ctx, state, &ev, row);
+
+done:
+	MemoryContextSwitchTo(old_ctx);
+	MemoryContextReset(state->row_ctx);
+}
+
+static void decoder_truncate(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+			     int nrelations, Relation relations[], ReorderBufferChange *change)
+{
+	struct DecodeState *state = ctx->output_plugin_private;
+	struct DecodeRelInfo *entry;
+	struct PgqTriggerEvent ev;
+	TriggerData tg;
+	MemoryContext old_ctx;
+	int i;
+
+	old_ctx = MemoryContextSwitchTo(state->row_ctx);
+	for (i = 0; i < nrelations; i++) {
+		entry = find_rel_info(state, relations[i]);
+		if (entry->skip)
+			continue;
+		init_event(&ev, &tg, entry, relations[i], 'R');
+		write_event(ctx, state, &ev, NULL);
+	}
+	MemoryContextSwitchTo(old_ctx);
+	MemoryContextReset(state->row_ctx);
+}
+
+/*
+ * Empty line marks end of transaction, reader stores
+ * its LSN as applied position.
+ */
+static void decoder_commit(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, XLogRecPtr commit_lsn)
+{
+	OutputPluginPrepareWrite(ctx, true);
+	OutputPluginWrite(ctx, true);
+}
+
+void _PG_output_plugin_init(OutputPluginCallbacks *cb)
+{
+	cb->startup_cb = decoder_startup;
+	cb->begin_cb = decoder_begin;
+	cb->change_cb = decoder_change;
+	cb->truncate_cb = decoder_truncate;
+	cb->commit_cb = decoder_commit;
+	cb->shutdown_cb = decoder_shutdown;
+}
+
+#endif
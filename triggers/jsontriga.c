@@ -27,6 +27,11 @@
 #include <utils/date.h>
 #include <utils/datetime.h>
 #include <utils/timestamp.h>
+#include <utils/builtins.h>
+#include <utils/lsyscache.h>
+#include <utils/array.h>
+#include <utils/uuid.h>
+#include <utils/jsonb.h>
 #include <miscadmin.h>
 
 #include "common.h"
@@ -87,6 +92,32 @@ static void EncodeSpecialDate(DateADT dt, char *str)
 
 #endif
 
+#if PG_VERSION_NUM < 110000
+#define DatumGetJsonbP(d) DatumGetJsonb(d)
+#endif
+
+/*
+ * Value encodings, resolved once per column.
+ */
+enum JsonKind {
+	JSON_UNKNOWN = 0,	/* not resolved yet */
+	JSON_TEXT,		/* output function, quoted */
+	JSON_BOOL,
+	JSON_INT2,
+	JSON_INT4,
+	JSON_INT8,
+	JSON_FLOAT4,
+	JSON_FLOAT8,
+	JSON_NUMERIC,
+	JSON_UUID,
+	JSON_JSON,
+	JSON_JSONB,
+	JSON_DATE,
+	JSON_TIMESTAMP,
+	JSON_TIMESTAMPTZ,
+	JSON_ARRAY,		/* 1-D array of native type */
+};
+
 static void timestamp_to_json(Datum val, StringInfo dst)
 {
 	char buf[MAXDATELEN + 1];
@@ -140,21 +171,238 @@ static void date_to_json(Datum val, StringInfo dst)
 	appendStringInfo(dst, "\"%s\"", buf);
 }
 
+/*
+ * Numbers are written as-is, special values like NaN
+ * are quoted, as to_json() does.
+ */
+static void number_to_json(Datum str_datum, StringInfo dst)
+{
+	char *str = DatumGetCString(str_datum);
+	const char *p = str;
+
+	if (*p == '-')
+		p++;
+	if (*p >= '0' && *p <= '9')
+		appendStringInfoString(dst, str);
+	else
+		pgq_encode_cstring(dst, str, TBUF_QUOTE_JSON);
+	pfree(str);
+}
+
+static void uuid_to_json(Datum val, StringInfo dst)
+{
+	static const char hextbl[] = "0123456789abcdef";
+	const unsigned char *data = DatumGetUUIDP(val)->data;
+	char *p;
+	int i;
+
+	enlargeStringInfo(dst, UUID_LEN * 2 + 6);
+	p = dst->data + dst->len;
+	*p++ = '"';
+	for (i = 0; i < UUID_LEN; i++) {
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*p++ = '-';
+		*p++ = hextbl[data[i] >> 4];
+		*p++ = hextbl[data[i] & 15];
+	}
+	*p++ = '"';
+	*p = 0;
+	dst->len = p - dst->data;
+}
+
+/* json value is valid JSON already, embed as-is */
+static void json_to_json(Datum val, StringInfo dst)
+{
+	text *txt = DatumGetTextPP(val);
+
+	appendBinaryStringInfo(dst, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
+	if ((Pointer)txt != DatumGetPointer(val))
+		pfree(txt);
+}
+
+static void jsonb_to_json(Datum val, StringInfo dst)
+{
+	Jsonb *jb = DatumGetJsonbP(val);
+
+	JsonbToCString(dst, &jb->root, VARSIZE(jb));
+	if ((Pointer)jb != DatumGetPointer(val))
+		pfree(jb);
+}
+
+static int json_kind_for_type(Oid typid)
+{
+	switch (typid) {
+	case BOOLOID:
+		return JSON_BOOL;
+	case INT2OID:
+		return JSON_INT2;
+	case INT4OID:
+		return JSON_INT4;
+	case INT8OID:
+		return JSON_INT8;
+	case FLOAT4OID:
+		return JSON_FLOAT4;
+	case FLOAT8OID:
+		return JSON_FLOAT8;
+	case NUMERICOID:
+		return JSON_NUMERIC;
+	case UUIDOID:
+		return JSON_UUID;
+	case JSONOID:
+		return JSON_JSON;
+	case JSONBOID:
+		return JSON_JSONB;
+	case DATEOID:
+		return JSON_DATE;
+	case TIMESTAMPOID:
+		return JSON_TIMESTAMP;
+	case TIMESTAMPTZOID:
+		return JSON_TIMESTAMPTZ;
+	default:
+		return JSON_TEXT;
+	}
+}
+
+/*
+ * Element types whose 1-D arrays are written as JSON arrays.
+ * Arrays of other types stay in their text form.
+ */
+static bool json_array_elem_kind(int kind)
+{
+	switch (kind) {
+	case JSON_INT8:
+	case JSON_FLOAT4:
+	case JSON_FLOAT8:
+	case JSON_NUMERIC:
+	case JSON_UUID:
+	case JSON_JSON:
+	case JSON_JSONB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Decide how column is encoded.
+ */
+static void resolve_json_kind(struct PgqColumnInfo *col)
+{
+	Oid elemtype;
+	int kind;
+
+	kind = json_kind_for_type(col->typid);
+	if (kind == JSON_TEXT) {
+		elemtype = get_element_type(col->typid);
+		if (OidIsValid(elemtype) && json_array_elem_kind(json_kind_for_type(elemtype))) {
+			col->json_elem_kind = json_kind_for_type(elemtype);
+			col->elemtype = elemtype;
+			get_typlenbyvalalign(elemtype, &col->elmlen, &col->elmbyval, &col->elmalign);
+			kind = JSON_ARRAY;
+		}
+	}
+	col->json_kind = kind;
+}
+
+static void value_to_json(int kind, Datum val, StringInfo dst)
+{
+	switch (kind) {
+	case JSON_BOOL:
+		if (DatumGetBool(val)) {
+			appendStringInfoString(dst, "true");
+		} else {
+			appendStringInfoString(dst, "false");
+		}
+		break;
+	case JSON_INT2:
+		appendStringInfo(dst, "%d", (int)DatumGetInt16(val));
+		break;
+	case JSON_INT4:
+		appendStringInfo(dst, "%d", (int)DatumGetInt32(val));
+		break;
+	case JSON_INT8:
+		appendStringInfo(dst, INT64_FORMAT, DatumGetInt64(val));
+		break;
+	case JSON_FLOAT4:
+		number_to_json(DirectFunctionCall1(float4out, val), dst);
+		break;
+	case JSON_FLOAT8:
+		number_to_json(DirectFunctionCall1(float8out, val), dst);
+		break;
+	case JSON_NUMERIC:
+		number_to_json(DirectFunctionCall1(numeric_out, val), dst);
+		break;
+	case JSON_UUID:
+		uuid_to_json(val, dst);
+		break;
+	case JSON_JSON:
+		json_to_json(val, dst);
+		break;
+	case JSON_JSONB:
+		jsonb_to_json(val, dst);
+		break;
+	case JSON_DATE:
+		date_to_json(val, dst);
+		break;
+	case JSON_TIMESTAMP:
+		timestamp_to_json(val, dst);
+		break;
+	case JSON_TIMESTAMPTZ:
+		timestamptz_to_json(val, dst);
+		break;
+	default:
+		elog(ERROR, "jsontriga: unexpected value kind %d", kind);
+	}
+}
+
+static void array_to_json(struct PgqColumnInfo *col, Datum val, StringInfo dst)
+{
+	ArrayType *arr = DatumGetArrayTypeP(val);
+	Datum *elems;
+	bool *nulls;
+	char *str;
+	int i, n;
+
+	/* multi-dimensional arrays stay in text form */
+	if (ARR_NDIM(arr) > 1) {
+		str = OutputFunctionCall(&col->output, PointerGetDatum(arr));
+		pgq_encode_cstring(dst, str, TBUF_QUOTE_JSON);
+		pfree(str);
+	} else {
+		deconstruct_array(arr, col->elemtype, col->elmlen, col->elmbyval, col->elmalign,
+				  &elems, &nulls, &n);
+		appendStringInfoChar(dst, '[');
+		for (i = 0; i < n; i++) {
+			if (i > 0)
+				appendStringInfoChar(dst, ',');
+			if (nulls[i])
+				appendStringInfoString(dst, "null");
+			else
+				value_to_json(col->json_elem_kind, elems[i], dst);
+		}
+		appendStringInfoChar(dst, ']');
+		pfree(elems);
+		pfree(nulls);
+	}
+
+	if ((Pointer)arr != DatumGetPointer(val))
+		pfree(arr);
+}
+
 /*
  * Convert row to JSON
  */
 
 void pgq_jsonenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 {
-	Oid col_type;
 	Datum col_datum;
 	bool isnull;
 	TriggerData *tg = ev->tgdata;
 	TupleDesc tupdesc = tg->tg_relation->rd_att;
+	struct PgqColumnInfo *col;
 	bool first = true;
 	int i;
-	const char *col_ident, *col_value;
-	int attkind_idx = -1;
+	const char *col_value;
 
 	if (ev->op_type == 'R') {
 		appendStringInfoString(buf, "{}");
@@ -162,14 +410,11 @@ void pgq_jsonenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 	}
 
 	appendStringInfoChar(buf, '{');
-	for (i = 0; i < tg->tg_relation->rd_att->natts; i++) {
-		/* Skip dropped columns */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (col->flags & PGQ_COL_SKIP)
 			continue;
-
-		attkind_idx++;
-
-		if (pgqtriga_skip_col(ev, i, attkind_idx))
+		if (pgq_delta_skip_col(ev, i, row))
 			continue;
 
 		if (first)
@@ -177,57 +422,33 @@ void pgq_jsonenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 		else
 			appendStringInfoChar(buf, ',');
 
-		/* quote column name */
-		col_ident = SPI_fname(tupdesc, i + 1);
-		pgq_encode_cstring(buf, col_ident, TBUF_QUOTE_JSON);
+		/* column name is pre-quoted */
+		appendStringInfoString(buf, col->name_json);
 		appendStringInfoChar(buf, ':');
 
 		/* quote column value */
-		col_type = TupleDescAttr(tupdesc, i)->atttypid;
-		col_datum = SPI_getbinval(row, tupdesc, i + 1, &isnull);
+		col_datum = SPI_getbinval(row, tupdesc, col->attno + 1, &isnull);
 		col_value = NULL;
 		if (isnull) {
 			appendStringInfoString(buf, "null");
 			continue;
 		}
 
-		switch (col_type) {
-		case BOOLOID:
-			if (DatumGetBool(col_datum)) {
-				appendStringInfoString(buf, "true");
-			} else {
-				appendStringInfoString(buf, "false");
-			}
-			break;
-
-		case TIMESTAMPOID:
-			timestamp_to_json(col_datum, buf);
-			break;
-
-		case TIMESTAMPTZOID:
-			timestamptz_to_json(col_datum, buf);
-			break;
-
-		case DATEOID:
-			date_to_json(col_datum, buf);
-			break;
-
-		case INT2OID:
-			appendStringInfo(buf, "%d", (int)DatumGetInt16(col_datum));
-			break;
+		if (col->json_kind == JSON_UNKNOWN)
+			resolve_json_kind(col);
 
-		case INT4OID:
-			appendStringInfo(buf, "%d", (int)DatumGetInt32(col_datum));
+		switch (col->json_kind) {
+		case JSON_TEXT:
+			col_value = pgq_col_value(col, row, tupdesc);
+			pgq_encode_cstring(buf, col_value, TBUF_QUOTE_JSON);
 			break;
 
-		case INT8OID:
-			col_value = SPI_getvalue(row, tupdesc, i + 1);
-			appendStringInfoString(buf, col_value);
+		case JSON_ARRAY:
+			array_to_json(col, col_datum, buf);
 			break;
 
 		default:
-			col_value = SPI_getvalue(row, tupdesc, i + 1);
-			pgq_encode_cstring(buf, col_value, TBUF_QUOTE_JSON);
+			value_to_json(col->json_kind, col_datum, buf);
 			break;
 		}
 
@@ -237,7 +458,7 @@ void pgq_jsonenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 	appendStringInfoChar(buf, '}');
 }
 
-static void fill_json_type(PgqTriggerEvent *ev, HeapTuple row, StringInfo ev_type)
+void pgq_jsonenc_type(PgqTriggerEvent *ev, StringInfo ev_type)
 {
 	appendStringInfo(ev_type, "{\"op\":\"%s\"", ev->op_type_str);
 	if (ev->tgargs->pkey_list) {
@@ -270,6 +491,38 @@ static void fill_json_type(PgqTriggerEvent *ev, HeapTuple row, StringInfo ev_typ
 	appendStringInfoChar(ev_type, '}');
 }
 
+/*
+ * Create event for one row.  If batch is given, event
+ * is added there, otherwise inserted immediately.
+ *
+ * Returns true if operation should be skipped.
+ */
+static bool jsontriga_event(TriggerData *tg, HeapTuple row, struct PgqEventBatch *batch)
+{
+	struct PgqTriggerEvent ev;
+
+	pgq_prepare_event(&ev, tg, true, pgq_jsonenc_row);
+	ev.batch = batch;
+
+	appendStringInfoString(ev.field[EV_EXTRA1], ev.info->table_name);
+
+	pgq_jsonenc_type(&ev, ev.field[EV_TYPE]);
+
+	if (pgq_is_interesting_change(&ev, tg)) {
+		/*
+		 * create type, data
+		 */
+		pgq_jsonenc_row(&ev, row, ev.field[EV_DATA]);
+
+		/*
+		 * Construct the parameter array and insert the log row.
+		 */
+		pgq_insert_tg_event(&ev);
+	}
+
+	return ev.tgargs->skip;
+}
+
 /*
  * PgQ log trigger, takes 2 arguments:
  * 1. queue name to be inserted to.
@@ -283,7 +536,6 @@ static void fill_json_type(PgqTriggerEvent *ev, HeapTuple row, StringInfo ev_typ
 Datum pgq_jsontriga(PG_FUNCTION_ARGS)
 {
 	TriggerData *tg;
-	struct PgqTriggerEvent ev;
 	HeapTuple row;
 	bool skip = false;
 
@@ -308,24 +560,10 @@ Datum pgq_jsontriga(PG_FUNCTION_ARGS)
 	if (SPI_connect() < 0)
 		elog(ERROR, "logutriga: SPI_connect() failed");
 
-	pgq_prepare_event(&ev, tg, true, true);
-	skip = ev.tgargs->skip;
-
-	appendStringInfoString(ev.field[EV_EXTRA1], ev.info->table_name);
-
-	fill_json_type(&ev, row, ev.field[EV_TYPE]);
-
-	if (pgq_is_interesting_change(&ev, tg)) {
-		/*
-		 * create type, data
-		 */
-		pgq_jsonenc_row(&ev, row, ev.field[EV_DATA]);
-
-		/*
-		 * Construct the parameter array and insert the log row.
-		 */
-		pgq_insert_tg_event(&ev);
-	}
+	if (pgq_is_transition_trigger(tg))
+		pgq_transition_events(tg, jsontriga_event);
+	else
+		skip = jsontriga_event(tg, row, NULL);
 
 	if (SPI_finish() < 0)
 		elog(ERROR, "SPI_finish failed");
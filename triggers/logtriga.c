@@ -64,7 +64,7 @@ Datum pgq_logtriga(PG_FUNCTION_ARGS)
 	if (SPI_connect() < 0)
 		elog(ERROR, "logtriga: SPI_connect() failed");
 
-	pgq_prepare_event(&ev, tg, false, false);
+	pgq_prepare_event(&ev, tg, false, pgq_urlenc_row);
 
 	appendStringInfoChar(ev.field[EV_TYPE], ev.op_type);
 	appendStringInfoString(ev.field[EV_EXTRA1], ev.info->table_name);
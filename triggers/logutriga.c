@@ -33,22 +33,19 @@ void pgq_urlenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 {
 	TriggerData *tg = ev->tgdata;
 	TupleDesc tupdesc = tg->tg_relation->rd_att;
+	struct PgqColumnInfo *col;
 	bool first = true;
 	int i;
-	const char *col_ident, *col_value;
-	int attkind_idx = -1;
+	const char *col_value;
 
 	if (ev->op_type == 'R')
 		return;
 
-	for (i = 0; i < tg->tg_relation->rd_att->natts; i++) {
-		/* Skip dropped columns */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (col->flags & PGQ_COL_SKIP)
 			continue;
-
-		attkind_idx++;
-
-		if (pgqtriga_skip_col(ev, i, attkind_idx))
+		if (pgq_delta_skip_col(ev, i, row))
 			continue;
 
 		if (first)
@@ -56,12 +53,11 @@ void pgq_urlenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 		else
 			appendStringInfoChar(buf, '&');
 
-		/* quote column name */
-		col_ident = SPI_fname(tupdesc, i + 1);
-		pgq_encode_cstring(buf, col_ident, TBUF_QUOTE_URLENC);
+		/* column name is pre-quoted */
+		appendStringInfoString(buf, col->name_urlenc);
 
 		/* quote column value */
-		col_value = SPI_getvalue(row, tupdesc, i + 1);
+		col_value = pgq_col_value(col, row, tupdesc);
 		if (col_value != NULL) {
 			appendStringInfoChar(buf, '=');
 			pgq_encode_cstring(buf, col_value, TBUF_QUOTE_URLENC);
@@ -69,6 +65,41 @@ void pgq_urlenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 	}
 }
 
+/*
+ * Create event for one row.  If batch is given, event
+ * is added there, otherwise inserted immediately.
+ *
+ * Returns true if operation should be skipped.
+ */
+static bool logutriga_event(TriggerData *tg, HeapTuple row, struct PgqEventBatch *batch)
+{
+	struct PgqTriggerEvent ev;
+
+	pgq_prepare_event(&ev, tg, true, pgq_urlenc_row);
+	ev.batch = batch;
+
+	appendStringInfoString(ev.field[EV_EXTRA1], ev.info->table_name);
+	appendStringInfoChar(ev.field[EV_TYPE], ev.op_type);
+	if (ev.op_type != 'R') {
+		appendStringInfoChar(ev.field[EV_TYPE], ':');
+		appendStringInfoString(ev.field[EV_TYPE], ev.pkey_list);
+	}
+
+	if (pgq_is_interesting_change(&ev, tg)) {
+		/*
+		 * create type, data
+		 */
+		pgq_urlenc_row(&ev, row, ev.field[EV_DATA]);
+
+		/*
+		 * Construct the parameter array and insert the log row.
+		 */
+		pgq_insert_tg_event(&ev);
+	}
+
+	return ev.tgargs->skip;
+}
+
 /*
  * PgQ log trigger, takes 2 arguments:
  * 1. queue name to be inserted to.
@@ -82,7 +113,6 @@ void pgq_urlenc_row(PgqTriggerEvent *ev, HeapTuple row, StringInfo buf)
 Datum pgq_logutriga(PG_FUNCTION_ARGS)
 {
 	TriggerData *tg;
-	struct PgqTriggerEvent ev;
 	HeapTuple row;
 	bool skip = false;
 
@@ -107,27 +137,10 @@ Datum pgq_logutriga(PG_FUNCTION_ARGS)
 	if (SPI_connect() < 0)
 		elog(ERROR, "logutriga: SPI_connect() failed");
 
-	pgq_prepare_event(&ev, tg, true, false);
-	skip = ev.tgargs->skip;
-
-	appendStringInfoString(ev.field[EV_EXTRA1], ev.info->table_name);
-	appendStringInfoChar(ev.field[EV_TYPE], ev.op_type);
-	if (ev.op_type != 'R') {
-		appendStringInfoChar(ev.field[EV_TYPE], ':');
-		appendStringInfoString(ev.field[EV_TYPE], ev.pkey_list);
-	}
-
-	if (pgq_is_interesting_change(&ev, tg)) {
-		/*
-		 * create type, data
-		 */
-		pgq_urlenc_row(&ev, row, ev.field[EV_DATA]);
-
-		/*
-		 * Construct the parameter array and insert the log row.
-		 */
-		pgq_insert_tg_event(&ev);
-	}
+	if (pgq_is_transition_trigger(tg))
+		pgq_transition_events(tg, logutriga_event);
+	else
+		skip = logutriga_event(tg, row, NULL);
 
 	if (SPI_finish() < 0)
 		elog(ERROR, "SPI_finish failed");
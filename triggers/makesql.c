@@ -33,19 +33,19 @@
 #include "stringutil.h"
 
 
-static void append_key_eq(StringInfo buf, const char *col_ident, const char *col_value)
+static void append_key_eq(StringInfo buf, struct PgqColumnInfo *col, const char *col_value)
 {
 	if (col_value == NULL)
 		elog(ERROR, "logtriga: Unexpected NULL key value");
 
-	pgq_encode_cstring(buf, col_ident, TBUF_QUOTE_IDENT);
+	appendStringInfoString(buf, col->name_ident);
 	appendStringInfoChar(buf, '=');
 	pgq_encode_cstring(buf, col_value, TBUF_QUOTE_LITERAL);
 }
 
-static void append_normal_eq(StringInfo buf, const char *col_ident, const char *col_value)
+static void append_normal_eq(StringInfo buf, struct PgqColumnInfo *col, const char *col_value)
 {
-	pgq_encode_cstring(buf, col_ident, TBUF_QUOTE_IDENT);
+	appendStringInfoString(buf, col->name_ident);
 	appendStringInfoChar(buf, '=');
 	if (col_value != NULL)
 		pgq_encode_cstring(buf, col_value, TBUF_QUOTE_LITERAL);
@@ -58,25 +58,19 @@ static void process_insert(PgqTriggerEvent *ev, StringInfo sql)
 	TriggerData *tg = ev->tgdata;
 	HeapTuple new_row = tg->tg_trigtuple;
 	TupleDesc tupdesc = tg->tg_relation->rd_att;
+	struct PgqColumnInfo *col;
 	int i;
 	int need_comma = false;
-	int attkind_idx;
 
 	/*
 	 * Specify all the columns
 	 */
 	appendStringInfoChar(sql, '(');
-	attkind_idx = -1;
-	for (i = 0; i < tupdesc->natts; i++) {
-		char *col_ident;
-
-		/* Skip dropped columns */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
-			continue;
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
 
 		/* Check if allowed by colstring */
-		attkind_idx++;
-		if (pgqtriga_skip_col(ev, i, attkind_idx))
+		if (col->flags & PGQ_COL_SKIP)
 			continue;
 
 		if (need_comma)
@@ -84,9 +78,8 @@ static void process_insert(PgqTriggerEvent *ev, StringInfo sql)
 		else
 			need_comma = true;
 
-		/* quote column name */
-		col_ident = SPI_fname(tupdesc, i + 1);
-		pgq_encode_cstring(sql, col_ident, TBUF_QUOTE_IDENT);
+		/* column name is pre-quoted */
+		appendStringInfoString(sql, col->name_ident);
 	}
 
 	/*
@@ -98,17 +91,13 @@ static void process_insert(PgqTriggerEvent *ev, StringInfo sql)
 	 * Append the values
 	 */
 	need_comma = false;
-	attkind_idx = -1;
-	for (i = 0; i < tupdesc->natts; i++) {
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
 		char *col_value;
 
-		/* Skip dropped columns */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
-			continue;
+		col = &ev->tgargs->columns[i];
 
 		/* Check if allowed by colstring */
-		attkind_idx++;
-		if (pgqtriga_skip_col(ev, i, attkind_idx))
+		if (col->flags & PGQ_COL_SKIP)
 			continue;
 
 		if (need_comma)
@@ -117,7 +106,7 @@ static void process_insert(PgqTriggerEvent *ev, StringInfo sql)
 			need_comma = true;
 
 		/* quote column value */
-		col_value = SPI_getvalue(new_row, tupdesc, i + 1);
+		col_value = pgq_col_value(col, new_row, tupdesc);
 		if (col_value == NULL)
 			appendStringInfoString(sql, "null");
 		else
@@ -136,83 +125,24 @@ static int process_update(PgqTriggerEvent *ev, StringInfo sql)
 	HeapTuple old_row = tg->tg_trigtuple;
 	HeapTuple new_row = tg->tg_newtuple;
 	TupleDesc tupdesc = tg->tg_relation->rd_att;
-	Datum old_value;
-	Datum new_value;
-	bool old_isnull;
-	bool new_isnull;
+	struct PgqColumnInfo *col;
 
-	char *col_ident;
 	char *col_value;
 	int i;
 	int need_comma = false;
 	int need_and = false;
-	int attkind_idx;
 	int ignore_count = 0;
 
-	attkind_idx = -1;
-	for (i = 0; i < tupdesc->natts; i++) {
-		/*
-		 * Ignore dropped columns
-		 */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
-			continue;
-
-		attkind_idx++;
-
-		old_value = SPI_getbinval(old_row, tupdesc, i + 1, &old_isnull);
-		new_value = SPI_getbinval(new_row, tupdesc, i + 1, &new_isnull);
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
 
-		/*
-		 * If old and new value are NULL, the column is unchanged
-		 */
-		if (old_isnull && new_isnull)
+		if (!pgq_column_changed(col, old_row, new_row, tupdesc))
 			continue;
 
-		/*
-		 * If both are NOT NULL, we need to compare the values and skip
-		 * setting the column if equal
-		 */
-		if (!old_isnull && !new_isnull) {
-			Oid opr_oid;
-			FmgrInfo *opr_finfo_p;
-
-			/*
-			 * Lookup the equal operators function call info using the
-			 * typecache if available
-			 */
-			TypeCacheEntry *type_cache;
-
-			type_cache = lookup_type_cache(SPI_gettypeid(tupdesc, i + 1),
-						       TYPECACHE_EQ_OPR | TYPECACHE_EQ_OPR_FINFO);
-			opr_oid = type_cache->eq_opr;
-			if (opr_oid == ARRAY_EQ_OP)
-				opr_oid = InvalidOid;
-			else
-				opr_finfo_p = &(type_cache->eq_opr_finfo);
-
-			/*
-			 * If we have an equal operator, use that to do binary
-			 * comparison. Else get the string representation of both
-			 * attributes and do string comparison.
-			 */
-			if (OidIsValid(opr_oid)) {
-				if (DatumGetBool(FunctionCall2Coll(opr_finfo_p,
-								   TupleDescAttr(tupdesc, i)->attcollation,
-								   old_value, new_value)))
-					continue;
-			} else {
-				char *old_strval = SPI_getvalue(old_row, tupdesc, i + 1);
-				char *new_strval = SPI_getvalue(new_row, tupdesc, i + 1);
-
-				if (strcmp(old_strval, new_strval) == 0)
-					continue;
-			}
-		}
-
-		if (pgqtriga_is_pkey(ev, i, attkind_idx))
+		if (col->flags & PGQ_COL_PKEY)
 			elog(ERROR, "primary key update not allowed");
 
-		if (pgqtriga_skip_col(ev, i, attkind_idx)) {
+		if (col->flags & PGQ_COL_SKIP) {
 			/* this change should be ignored */
 			ignore_count++;
 			continue;
@@ -223,10 +153,9 @@ static int process_update(PgqTriggerEvent *ev, StringInfo sql)
 		else
 			need_comma = true;
 
-		col_ident = SPI_fname(tupdesc, i + 1);
-		col_value = SPI_getvalue(new_row, tupdesc, i + 1);
+		col_value = pgq_col_value(col, new_row, tupdesc);
 
-		append_normal_eq(sql, col_ident, col_value);
+		append_normal_eq(sql, col, col_value);
 	}
 
 	/*
@@ -241,42 +170,33 @@ static int process_update(PgqTriggerEvent *ev, StringInfo sql)
 		if (ignore_count > 0)
 			return 0;
 
-		for (i = 0, attkind_idx = -1; i < tupdesc->natts; i++) {
-			if (TupleDescAttr(tupdesc, i)->attisdropped)
-				continue;
-
-			attkind_idx++;
-			if (pgqtriga_is_pkey(ev, i, attkind_idx))
+		for (i = 0; i < ev->tgargs->n_columns; i++) {
+			col = &ev->tgargs->columns[i];
+			if (col->flags & PGQ_COL_PKEY)
 				break;
 		}
-		col_ident = SPI_fname(tupdesc, i + 1);
-		col_value = SPI_getvalue(old_row, tupdesc, i + 1);
+		if (i >= ev->tgargs->n_columns)
+			elog(ERROR, "logtriga: no key column found");
+		col_value = pgq_col_value(col, old_row, tupdesc);
 
-		append_key_eq(sql, col_ident, col_value);
+		append_key_eq(sql, col, col_value);
 	}
 
 	appendStringInfoString(sql, " where ");
 
-	for (i = 0, attkind_idx = -1; i < tupdesc->natts; i++) {
-		/*
-		 * Ignore dropped columns
-		 */
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (!(col->flags & PGQ_COL_PKEY))
 			continue;
 
-		attkind_idx++;
-		if (!pgqtriga_is_pkey(ev, i, attkind_idx))
-			continue;
-
-		col_ident = SPI_fname(tupdesc, i + 1);
-		col_value = SPI_getvalue(old_row, tupdesc, i + 1);
+		col_value = pgq_col_value(col, old_row, tupdesc);
 
 		if (need_and)
 			appendStringInfoString(sql, " and ");
 		else
 			need_and = true;
 
-		append_key_eq(sql, col_ident, col_value);
+		append_key_eq(sql, col, col_value);
 	}
 	return 1;
 }
@@ -286,28 +206,23 @@ static void process_delete(PgqTriggerEvent *ev, StringInfo sql)
 	TriggerData *tg = ev->tgdata;
 	HeapTuple old_row = tg->tg_trigtuple;
 	TupleDesc tupdesc = tg->tg_relation->rd_att;
-	char *col_ident;
+	struct PgqColumnInfo *col;
 	char *col_value;
 	int i;
 	int need_and = false;
-	int attkind_idx;
-
-	for (i = 0, attkind_idx = -1; i < tupdesc->natts; i++) {
-		if (TupleDescAttr(tupdesc, i)->attisdropped)
-			continue;
 
-		attkind_idx++;
-		if (!pgqtriga_is_pkey(ev, i, attkind_idx))
+	for (i = 0; i < ev->tgargs->n_columns; i++) {
+		col = &ev->tgargs->columns[i];
+		if (!(col->flags & PGQ_COL_PKEY))
 			continue;
-		col_ident = SPI_fname(tupdesc, i + 1);
-		col_value = SPI_getvalue(old_row, tupdesc, i + 1);
+		col_value = pgq_col_value(col, old_row, tupdesc);
 
 		if (need_and)
 			appendStringInfoString(sql, " and ");
 		else
 			need_and = true;
 
-		append_key_eq(sql, col_ident, col_value);
+		append_key_eq(sql, col, col_value);
 	}
 }
 
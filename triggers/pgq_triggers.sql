@@ -15,6 +15,8 @@
 --      ignore=col1[,col2]  - don't look at the specified arguments
 --      pkey=col1[,col2]    - Set pkey fields for the table, autodetection will be skipped
 --      backup              - Put contents of old row to ev_extra2 (urlenc/json)
+--      delta               - UPDATE event contains only pkey and changed columns,
+--                            backup only old values of changed columns
 --      colname=EXPR        - Override field value with SQL expression.  Can reference table
 --                            columns.  colname can be: ev_type, ev_data, ev_extra1 .. ev_extra4
 --      when=EXPR           - If EXPR returns false, don't insert event.
@@ -25,6 +27,13 @@
 --      ev_extra1    - table name
 --      ev_extra2    - optional backup of old row (urlenc/json)
 --
+-- Column values:
+--      bool, integer, float and numeric values are written as JSON booleans
+--      and numbers (NaN and Infinity as strings), json and jsonb values are
+--      embedded as-is, uuid, date and timestamp values as strings.
+--      1-D arrays of int8, float, numeric, uuid, json and jsonb become
+--      JSON arrays.  Other values are written as strings in their text form.
+--
 -- Regular listen trigger example:
 -- >   CREATE TRIGGER triga_nimi AFTER INSERT OR UPDATE ON customer
 -- >   FOR EACH ROW EXECUTE PROCEDURE pgq.jsontriga('qname');
@@ -32,10 +41,58 @@
 -- Redirect trigger example:
 -- >   CREATE TRIGGER triga_nimi BEFORE INSERT OR UPDATE ON customer
 -- >   FOR EACH ROW EXECUTE PROCEDURE pgq.jsontriga('qname', 'SKIP');
+--
+-- Statement trigger example, needs PostgreSQL 10+.  Events are same as from
+-- row trigger, but inserted with single pgq.insert_event_batch() call:
+-- >   CREATE TRIGGER triga_nimi AFTER UPDATE ON customer
+-- >   REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+-- >   FOR EACH STATEMENT EXECUTE PROCEDURE pgq.jsontriga('qname');
 -- ----------------------------------------------------------------------
 CREATE OR REPLACE FUNCTION pgq.jsontriga() RETURNS TRIGGER
 AS '$libdir/pgq_triggers', 'pgq_jsontriga' LANGUAGE C;
 
+-- ----------------------------------------------------------------------
+-- Function: pgq.bintriga()
+--
+--      Trigger function that puts row data in MessagePack form into queue.
+--
+-- Purpose:
+--      Row data that compiled consumers can decode without text parsing.
+--
+-- Trigger parameters:
+--      arg1 - queue name
+--      argX - any number of optional arg, in any order
+--
+-- Optional arguments:
+--      SKIP                - The actual operation should be skipped (BEFORE trigger)
+--      ignore=col1[,col2]  - don't look at the specified arguments
+--      pkey=col1[,col2]    - Set pkey fields for the table, autodetection will be skipped
+--      backup              - Put contents of old row to ev_extra2
+--      delta               - UPDATE event contains only pkey and changed columns,
+--                            backup only old values of changed columns
+--      colname=EXPR        - Override field value with SQL expression.  Can reference table
+--                            columns.  colname can be: ev_type, ev_data, ev_extra1 .. ev_extra4
+--      when=EXPR           - If EXPR returns false, don't insert event.
+--
+-- Queue event fields:
+--      ev_type      - I/U/D/R ':' pkey_column_list
+--      ev_data      - base64-encoded MessagePack map of column values
+--      ev_extra1    - table name
+--      ev_extra2    - optional backup of old row, same encoding
+--
+-- Column values:
+--      bool, int2/4/8, float4/8 and bytea use native MessagePack types,
+--      timestamp and timestamptz are integers of microseconds since
+--      1970-01-01 UTC.  NULL is nil, other types are strings in their
+--      text form.  Not available in PL-only install.
+--
+-- Regular listen trigger example:
+-- >   CREATE TRIGGER triga_nimi AFTER INSERT OR UPDATE ON customer
+-- >   FOR EACH ROW EXECUTE PROCEDURE pgq.bintriga('qname');
+-- ----------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION pgq.bintriga() RETURNS TRIGGER
+AS '$libdir/pgq_triggers', 'pgq_bintriga' LANGUAGE C;
+
 -- ----------------------------------------------------------------------
 -- Function: pgq.logutriga()
 --
@@ -55,6 +112,8 @@ AS '$libdir/pgq_triggers', 'pgq_jsontriga' LANGUAGE C;
 --      ignore=col1[,col2]  - don't look at the specified arguments
 --      pkey=col1[,col2]    - Set pkey fields for the table, autodetection will be skipped
 --      backup              - Put urlencoded contents of old row to ev_extra2
+--      delta               - UPDATE event contains only pkey and changed columns,
+--                            backup only old values of changed columns
 --      colname=EXPR        - Override field value with SQL expression.  Can reference table
 --                            columns.  colname can be: ev_type, ev_data, ev_extra1 .. ev_extra4
 --      when=EXPR           - If EXPR returns false, don't insert event.
@@ -72,6 +131,12 @@ AS '$libdir/pgq_triggers', 'pgq_jsontriga' LANGUAGE C;
 -- Redirect trigger example:
 -- >   CREATE TRIGGER triga_nimi BEFORE INSERT OR UPDATE ON customer
 -- >   FOR EACH ROW EXECUTE PROCEDURE pgq.logutriga('qname', 'SKIP');
+--
+-- Statement trigger example, needs PostgreSQL 10+.  Events are same as from
+-- row trigger, but inserted with single pgq.insert_event_batch() call:
+-- >   CREATE TRIGGER triga_nimi AFTER UPDATE ON customer
+-- >   REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+-- >   FOR EACH STATEMENT EXECUTE PROCEDURE pgq.logutriga('qname');
 -- ----------------------------------------------------------------------
 CREATE OR REPLACE FUNCTION pgq.logutriga() RETURNS TRIGGER
 AS '$libdir/pgq_triggers', 'pgq_logutriga' LANGUAGE C;
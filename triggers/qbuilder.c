@@ -1,6 +1,14 @@
 
 #include <postgres.h>
+#include <catalog/namespace.h>
 #include <executor/spi.h>
+#include <executor/executor.h>
+#include <nodes/nodeFuncs.h>
+#include <nodes/plannodes.h>
+#include <utils/datum.h>
+#include <utils/lsyscache.h>
+#include <utils/memutils.h>
+#include <utils/plancache.h>
 
 #include "qbuilder.h"
 #include "parsesql.h"
@@ -19,6 +27,36 @@ extern PGDLLIMPORT bool standard_conforming_strings;
 #define standard_conforming_strings 1
 #endif
 
+/*
+ * Plans are shared between triggers that have identical
+ * query text and argument types.  If query is plain
+ * "select <expr>", the expression is compiled once and
+ * evaluated directly, without executor startup per row.
+ * Entry is freed when last QueryBuilder using it is freed.
+ */
+struct QBShared {
+	struct QBShared *next;
+	int refcnt;
+	char *sql;
+	int nargs;
+	Oid *types;
+	void *plan;
+
+	/* compiled expression, rebuilt when plan is invalidated or search_path changes */
+	MemoryContext ctx;
+	bool checked;
+	char *search_path;
+	ExprState *state;
+	ExprContext *econtext;
+	ParamListInfo params;
+	Oid restype;
+
+	/* evaluation in progress, recursive calls use SPI */
+	bool busy;
+};
+
+static struct QBShared *shared_list;
+
 /* create QB in right context */
 struct QueryBuilder *qb_create(const struct QueryBuilderOps *ops, MemoryContext ctx)
 {
@@ -106,18 +144,71 @@ void qb_add_parse(struct QueryBuilder *q, const char *sql, void *arg)
 	}
 }
 
+static struct QBShared *qb_find_shared(const char *sql, int nargs, Oid *types)
+{
+	struct QBShared *sh;
+	void *plan;
+
+	for (sh = shared_list; sh; sh = sh->next) {
+		if (sh->nargs == nargs && strcmp(sh->sql, sql) == 0
+		    && memcmp(sh->types, types, nargs * sizeof(Oid)) == 0)
+		{
+			sh->refcnt++;
+			return sh;
+		}
+	}
+
+	plan = SPI_prepare(sql, nargs, types);
+
+	sh = MemoryContextAllocZero(TopMemoryContext, sizeof(*sh));
+	sh->sql = MemoryContextStrdup(TopMemoryContext, sql);
+	sh->nargs = nargs;
+	sh->types = MemoryContextAlloc(TopMemoryContext, (nargs + 1) * sizeof(Oid));
+	memcpy(sh->types, types, nargs * sizeof(Oid));
+	sh->plan = SPI_saveplan(plan);
+	sh->refcnt = 1;
+	sh->next = shared_list;
+	shared_list = sh;
+	return sh;
+}
+
+/* drop reference, free plan and expression when unused */
+static void qb_release_shared(struct QBShared *sh)
+{
+	struct QBShared **pp;
+
+	if (--sh->refcnt > 0)
+		return;
+
+	for (pp = &shared_list; *pp; pp = &(*pp)->next) {
+		if (*pp == sh) {
+			*pp = sh->next;
+			break;
+		}
+	}
+
+	if (sh->ctx) {
+		if (sh->econtext)
+			FreeExprContext(sh->econtext, true);
+		MemoryContextDelete(sh->ctx);
+	}
+	SPI_freeplan(sh->plan);
+	pfree(sh->types);
+	pfree(sh->sql);
+	pfree(sh);
+}
+
 /* prepare */
 void qb_prepare(struct QueryBuilder *q, void *arg)
 {
 	Oid types[FUNC_MAX_ARGS];
-	void *plan;
 	int i;
 
 	for (i = 0; i < q->nargs; i++)
 		types[i] = q->op->type_lookup(arg, q->arg_map[i]);
 
-	plan = SPI_prepare(q->sql.data, q->nargs, types);
-	q->plan = SPI_saveplan(plan);
+	q->shared = qb_find_shared(q->sql.data, q->nargs, types);
+	q->plan = q->shared->plan;
 }
 
 /* lookup values and run plan.  returns result from SPI_execute_plan()  */
@@ -138,14 +229,175 @@ int qb_execute(struct QueryBuilder *q, void *arg)
 	return SPI_execute_plan(q->plan, values, nulls, true, 0);
 }
 
+/*
+ * Take expression from plan if it is single Result node
+ * without subplans or set-returning functions.
+ */
+static Expr *qb_simple_expr(CachedPlan *cplan)
+{
+	PlannedStmt *stmt;
+	Plan *plan;
+	TargetEntry *tle;
+
+	if (list_length(cplan->stmt_list) != 1)
+		return NULL;
+	stmt = linitial(cplan->stmt_list);
+	if (!IsA(stmt, PlannedStmt) || stmt->commandType != CMD_SELECT)
+		return NULL;
+	if (stmt->subplans != NIL || stmt->rtable != NIL)
+		return NULL;
+
+	plan = stmt->planTree;
+	if (!IsA(plan, Result) || plan->lefttree || plan->righttree
+	    || plan->qual || plan->initPlan || ((Result *)plan)->resconstantqual)
+		return NULL;
+	if (list_length(plan->targetlist) != 1)
+		return NULL;
+
+	tle = linitial(plan->targetlist);
+	if (expression_returns_set((Node *)tle->expr))
+		return NULL;
+	return tle->expr;
+}
+
+static void qb_compile(struct QBShared *sh)
+{
+	CachedPlan *cplan;
+	MemoryContext old;
+	Expr *expr;
+	int i;
+
+	if (sh->ctx) {
+		if (sh->econtext)
+			FreeExprContext(sh->econtext, true);
+		MemoryContextDelete(sh->ctx);
+	}
+	sh->ctx = AllocSetContextCreate(TopMemoryContext, "pgq_triggers expression",
+#if (PG_VERSION_NUM >= 110000)
+					ALLOCSET_SMALL_SIZES
+#else
+					ALLOCSET_SMALL_MINSIZE,
+					ALLOCSET_SMALL_INITSIZE,
+					ALLOCSET_SMALL_MAXSIZE
+#endif
+					);
+	sh->state = NULL;
+	sh->econtext = NULL;
+	sh->checked = true;
+	sh->search_path = MemoryContextStrdup(sh->ctx, namespace_search_path);
+
+	/* this also revalidates the plan */
+	cplan = SPI_plan_get_cached_plan(sh->plan);
+	if (!cplan)
+		return;
+
+	old = MemoryContextSwitchTo(sh->ctx);
+	expr = qb_simple_expr(cplan);
+	if (expr) {
+		expr = copyObject(expr);
+		sh->restype = exprType((Node *)expr);
+		sh->state = ExecInitExpr(expr, NULL);
+		sh->econtext = CreateStandaloneExprContext();
+
+#if PG_VERSION_NUM >= 110000
+		sh->params = makeParamList(sh->nargs);
+#else
+		sh->params = palloc0(offsetof(ParamListInfoData, params)
+				     + sh->nargs * sizeof(ParamExternData));
+		sh->params->numParams = sh->nargs;
+#endif
+		for (i = 0; i < sh->nargs; i++) {
+			sh->params->params[i].pflags = PARAM_FLAG_CONST;
+			sh->params->params[i].ptype = sh->types[i];
+		}
+		sh->econtext->ecxt_param_list_info = sh->params;
+	}
+	MemoryContextSwitchTo(old);
+
+#if PG_VERSION_NUM >= 140000
+	ReleaseCachedPlan(cplan, CurrentResourceOwner);
+#else
+	ReleaseCachedPlan(cplan, true);
+#endif
+}
+
+/*
+ * Evaluate single-value query.  Result is valid until
+ * next call.
+ */
+Datum qb_eval(struct QueryBuilder *q, void *arg, bool *isnull, Oid *restype)
+{
+	struct QBShared *sh = q->shared;
+	ParamExternData *prm;
+	Datum res;
+	int i;
+
+	if (!sh)
+		elog(ERROR, "QB: query not prepared yet");
+
+	/* plan validity does not cover search_path, that is checked only on replan */
+	if (!sh->checked || !SPI_plan_is_valid(sh->plan)
+	    || strcmp(sh->search_path, namespace_search_path) != 0)
+		qb_compile(sh);
+
+	if (sh->state && !sh->busy) {
+		for (i = 0; i < q->nargs; i++) {
+			prm = &sh->params->params[i];
+			prm->value = q->op->value_lookup(arg, q->arg_map[i], &prm->isnull);
+		}
+
+		ResetExprContext(sh->econtext);
+		sh->busy = true;
+		/* keep entry alive even if caller's query is freed meanwhile */
+		sh->refcnt++;
+		PG_TRY();
+		{
+#if PG_VERSION_NUM >= 100000
+			res = ExecEvalExprSwitchContext(sh->state, sh->econtext, isnull);
+#else
+			res = ExecEvalExprSwitchContext(sh->state, sh->econtext, isnull, NULL);
+#endif
+		}
+		PG_CATCH();
+		{
+			sh->busy = false;
+			qb_release_shared(sh);
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		sh->busy = false;
+		if (sh->refcnt == 1 && !*isnull) {
+			/* query was freed meanwhile, result is in econtext memory */
+			int16 typlen;
+			bool typbyval;
+
+			get_typlenbyval(sh->restype, &typlen, &typbyval);
+			res = datumCopy(res, typbyval, typlen);
+		}
+		*restype = sh->restype;
+		qb_release_shared(sh);
+		return res;
+	}
+
+	if (qb_execute(q, arg) != SPI_OK_SELECT)
+		elog(ERROR, "Override query failed");
+	if (SPI_processed != 1)
+		elog(ERROR, "Expect 1 row from override query, got %d", (int)SPI_processed);
+
+	*restype = SPI_gettypeid(SPI_tuptable->tupdesc, 1);
+	return SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, isnull);
+}
+
 void qb_free(struct QueryBuilder *q)
 {
 	if (!q)
 		return;
-	if (q->plan)
-		SPI_freeplan(q->plan);
+	if (q->shared)
+		qb_release_shared(q->shared);
 	if (q->sql.data)
 		pfree(q->sql.data);
+	if (q->arg_map)
+		pfree(q->arg_map);
 	pfree(q);
 }
 
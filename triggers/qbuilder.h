@@ -24,6 +24,7 @@ struct QueryBuilder {
 	const struct QueryBuilderOps *op;
 
 	void *plan;
+	struct QBShared *shared;
 
 	int nargs;
 	int maxargs;
@@ -37,4 +38,5 @@ void qb_free(struct QueryBuilder *q);
 
 void qb_prepare(struct QueryBuilder *q, void *arg);
 int qb_execute(struct QueryBuilder *q, void *arg);
+Datum qb_eval(struct QueryBuilder *q, void *arg, bool *isnull, Oid *restype);
 
@@ -60,7 +60,7 @@ Datum pgq_sqltriga(PG_FUNCTION_ARGS)
 	if (SPI_connect() < 0)
 		elog(ERROR, "sqltriga: SPI_connect() failed");
 
-	pgq_prepare_event(&ev, tg, true, false);
+	pgq_prepare_event(&ev, tg, true, pgq_urlenc_row);
 	skip = ev.tgargs->skip;
 
 	appendStringInfoChar(ev.field[EV_TYPE], ev.op_type);
@@ -20,12 +20,12 @@
 #include <lib/stringinfo.h>
 #include <utils/memutils.h>
 #include <utils/builtins.h>
-#if PG_VERSION_NUM >= 90200
-#include <utils/json.h>
-#endif
 #if PG_VERSION_NUM >= 90300
 #include <access/htup_details.h>
 #endif
+#if PG_VERSION_NUM >= 160000
+#include <port/simd.h>
+#endif
 
 #include "stringutil.h"
 
@@ -113,18 +113,39 @@ loop:
  * quoting
  */
 
+/*
+ * Encoders copy runs of bytes that need no quoting
+ * in one go and look closer only at special bytes.
+ */
+
+static inline bool urlenc_safe(unsigned c)
+{
+	return (c >= '0' && c <= '9')
+		|| (c >= 'A' && c <= 'Z')
+		|| (c >= 'a' && c <= 'z')
+		|| c == '_' || c == '.' || c == '-';
+}
+
 static void pgq_urlencode(StringInfo buf, const char *src)
 {
 	static const char hextbl[] = "0123456789abcdef";
-	while (*src) {
-		unsigned c = (unsigned char)*src++;
+	int len = strlen(src);
+	int pos = 0, start;
+	unsigned c;
+
+	enlargeStringInfo(buf, len);
+	while (pos < len) {
+		start = pos;
+		while (pos < len && urlenc_safe((unsigned char)src[pos]))
+			pos++;
+		if (pos > start)
+			appendBinaryStringInfo(buf, src + start, pos - start);
+		if (pos >= len)
+			break;
+
+		c = (unsigned char)src[pos++];
 		if (c == ' ') {
 			appendStringInfoCharMacro(buf, '+');
-		} else if ((c >= '0' && c <= '9')
-			   || (c >= 'A' && c <= 'Z')
-			   || (c >= 'a' && c <= 'z')
-			   || c == '_' || c == '.' || c == '-') {
-			appendStringInfoCharMacro(buf, c);
 		} else {
 			appendStringInfoCharMacro(buf, '%');
 			appendStringInfoCharMacro(buf, hextbl[c >> 4]);
@@ -151,13 +172,54 @@ static void pgq_quote_ident(StringInfo buf, const char *src)
 		pfree((char *)quoted);
 }
 
-#if PG_VERSION_NUM < 90200
+/*
+ * Length of prefix that needs no JSON escaping.
+ * On PG16+ whole vectors are checked at once.
+ */
+static int json_safe_len(const char *src, int len)
+{
+	int i = 0;
+#if PG_VERSION_NUM >= 160000
+	Vector8 chunk;
 
-static void escape_json(StringInfo buf, const char *p)
+	for (; i + (int)sizeof(Vector8) <= len; i += sizeof(Vector8)) {
+		vector8_load(&chunk, (const uint8 *)src + i);
+		if (vector8_has_le(chunk, 0x1F)
+		    || vector8_has(chunk, '"')
+		    || vector8_has(chunk, '\\'))
+			break;
+	}
+#endif
+	for (; i < len; i++) {
+		unsigned char c = src[i];
+		if (c < ' ' || c == '"' || c == '\\')
+			break;
+	}
+	return i;
+}
+
+/*
+ * Same output as escape_json() in core.
+ */
+static void pgq_escape_json(StringInfo buf, const char *src)
 {
+	int len = strlen(src);
+	int pos = 0, run;
+	char c;
+
+	enlargeStringInfo(buf, len + 2);
 	appendStringInfoCharMacro(buf, '\"');
-	for (; *p; p++) {
-		switch (*p) {
+	while (pos < len) {
+		run = json_safe_len(src + pos, len - pos);
+		if (run > 0) {
+			appendBinaryStringInfo(buf, src + pos, run);
+			pos += run;
+			if (pos >= len)
+				break;
+		}
+
+		c = src[pos++];
+		switch (c) {
 		case '\b': appendStringInfoString(buf, "\\b"); break;
 		case '\f': appendStringInfoString(buf, "\\f"); break;
 		case '\n': appendStringInfoString(buf, "\\n"); break;
@@ -166,18 +228,13 @@ static void escape_json(StringInfo buf, const char *p)
 		case '"': appendStringInfoString(buf, "\\\""); break;
 		case '\\': appendStringInfoString(buf, "\\\\"); break;
 		default:
-			   if ((unsigned char) *p < ' ')
-				   appendStringInfo(buf, "\\u%04x", (int) *p);
-			   else
-				   appendStringInfoCharMacro(buf, *p);
-			   break;
+			appendStringInfo(buf, "\\u%04x", (int) c);
+			break;
 		}
 	}
 	appendStringInfoCharMacro(buf, '\"');
 }
 
-#endif
-
 void pgq_encode_cstring(StringInfo tbuf, const char *str, enum PgqEncode encoding)
 {
 	if (str == NULL)
@@ -197,7 +254,7 @@ void pgq_encode_cstring(StringInfo tbuf, const char *str, enum PgqEncode encodin
 		break;
 
 	case TBUF_QUOTE_JSON:
-		escape_json(tbuf, str);
+		pgq_escape_json(tbuf, str);
 		break;
 
 	default:
@@ -205,3 +262,37 @@ void pgq_encode_cstring(StringInfo tbuf, const char *str, enum PgqEncode encodin
 	}
 }
 
+
+/*
+ * Append base64 of binary data, without line breaks.
+ */
+void pgq_encode_base64(StringInfo buf, const uint8 *src, int len)
+{
+	static const char b64tbl[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const uint8 *end = src + len;
+	char *dst;
+	uint32 v;
+
+	enlargeStringInfo(buf, (len + 2) / 3 * 4);
+	dst = buf->data + buf->len;
+	while (end - src >= 3) {
+		v = (src[0] << 16) | (src[1] << 8) | src[2];
+		*dst++ = b64tbl[(v >> 18) & 0x3F];
+		*dst++ = b64tbl[(v >> 12) & 0x3F];
+		*dst++ = b64tbl[(v >> 6) & 0x3F];
+		*dst++ = b64tbl[v & 0x3F];
+		src += 3;
+	}
+	if (end - src > 0) {
+		v = src[0] << 16;
+		if (end - src > 1)
+			v |= src[1] << 8;
+		*dst++ = b64tbl[(v >> 18) & 0x3F];
+		*dst++ = b64tbl[(v >> 12) & 0x3F];
+		*dst++ = (end - src > 1) ? b64tbl[(v >> 6) & 0x3F] : '=';
+		*dst++ = '=';
+	}
+	*dst = 0;
+	buf->len = dst - buf->data;
+}